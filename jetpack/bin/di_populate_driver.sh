@@ -8,6 +8,11 @@ set -e
 $SCRIPTPATH/di_populate_devicetree.sh
 
 set -x
+# regenerate the tc358746 parameter table of the device tree modes
+mkdir -p "$BUILD_HOME/calc/build"
+(cd "$BUILD_HOME/calc/build" && cmake "$BUILD_HOME/calc")
+cmake --build "$BUILD_HOME/calc/build" --target modes
+
 # add source files
 cp "$DRIVER_SRC_DIR/dioneir.c" "$TEGRA_KERNEL_NV_HOME/nvidia/drivers/media/i2c"
 cp "$DRIVER_SRC_DIR/"tc358746*.[hc] "$TEGRA_KERNEL_NV_HOME/nvidia/drivers/media/i2c"
@@ -63,7 +68,7 @@ BEGIN {
 END {
   if (!found)
     print("obj-$(CONFIG_VIDEO_DIONE_IR) += dione_ir.o");
-    print("dione_ir-y += dioneir.o tc358746_calculation.o");
+    print("dione_ir-y += dioneir.o tc358746_calculation.o tc358746_program.o tc358746_regmap.o");
 }' "$MAKEFILE" > "$MAKEFILE.temp" && mv "$MAKEFILE.temp" "$MAKEFILE"
 
 # append dione_ir config to the defconfig
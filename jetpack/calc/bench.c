@@ -0,0 +1,253 @@
+/*
+ * Benchmark of the calculation library: the time per call of every stage of
+ * tc358746_calculate(), of the whole calculation and of the link frequency
+ * search, over a sweep of the design space. The library is included to reach
+ * its static stages.
+ *
+ * usage: calc_bench [repeats]
+ *
+ * Every stage runs over its inputs 'repeats' times (default 5), the fastest
+ * run is reported. The output is CSV, one line per stage:
+ *
+ * name,calls,ok,ns_per_call,calls_per_s
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "tc358746_calculation.c"
+
+static const u32 bench_formats[] = {
+	MEDIA_BUS_FMT_UYVY8_2X8,
+	MEDIA_BUS_FMT_UYVY8_1X16,
+	MEDIA_BUS_FMT_YUYV8_1X16,
+	MEDIA_BUS_FMT_UYVY10_2X10,
+	MEDIA_BUS_FMT_GBR888_1X24,
+	MEDIA_BUS_FMT_RGB888_1X24,
+	MEDIA_BUS_FMT_SRGGB8_1X8,
+	MEDIA_BUS_FMT_SRGGB10_1X10,
+	MEDIA_BUS_FMT_SRGGB12_1X12,
+	MEDIA_BUS_FMT_SRGGB14_1X14,
+};
+static const u32 bench_refclks[] = { 12000000, 24000000, 27000000, 37125000 };
+static const u32 bench_pclks[] = { 10000000, 20000000, 40000000, 83000000,
+				   148500000 };
+static const u32 bench_widths[] = { 320, 640, 1024, 1280, 1920 };
+static const u32 bench_hblanks[] = { 16, 54, 256, 1084 };
+
+#define BENCH_LANES		4
+#define BENCH_LINK_FREQS	16
+#define BENCH_LINK_FREQ_MIN	31250000ULL
+#define BENCH_LINK_FREQ_MAX	500000000ULL
+/* the link frequency search runs on every Nth input only */
+#define BENCH_FIND_STRIDE	256
+
+struct bench_stage {
+	const struct tc358746_input *input;
+	const struct tc358746_mbus_fmt *format;
+	struct tc358746_pll pll;
+	struct tc358746_csi csi;
+};
+
+static volatile u64 bench_sink;
+
+static u64 now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void report(const char *name, u64 calls, u64 ok, u64 ns)
+{
+	fprintf(stdout, "%s,%lu,%lu,%.1f,%.0f\n", name, calls, ok,
+		calls ? (double)ns / calls : 0.0,
+		ns ? calls * 1e9 / ns : 0.0);
+}
+
+static u32 build_sweep(struct tc358746_input *inputs)
+{
+	u32 n = 0;
+	u32 f, r, l, k, p, w, h;
+
+	for (f = 0; f < ARRAY_SIZE(bench_formats); f++)
+	for (r = 0; r < ARRAY_SIZE(bench_refclks); r++)
+	for (l = 1; l <= BENCH_LANES; l++)
+	for (k = 0; k < BENCH_LINK_FREQS; k++)
+	for (p = 0; p < ARRAY_SIZE(bench_pclks); p++)
+	for (w = 0; w < ARRAY_SIZE(bench_widths); w++)
+	for (h = 0; h < ARRAY_SIZE(bench_hblanks); h++) {
+		struct tc358746_input *input = inputs + n++;
+
+		*input = (struct tc358746_input) {
+			.mbus_fmt = bench_formats[f],
+			.refclk = bench_refclks[r],
+			.link_frequency = BENCH_LINK_FREQ_MIN +
+				(BENCH_LINK_FREQ_MAX - BENCH_LINK_FREQ_MIN) *
+				k / (BENCH_LINK_FREQS - 1),
+			.num_lanes = l,
+			.pclk = bench_pclks[p],
+			.width = bench_widths[w],
+			.hblank = bench_hblanks[h],
+		};
+	}
+
+	return n;
+}
+
+int main(int argc, char *argv[])
+{
+	int repeats = argc > 1 ? atoi(argv[1]) : 5;
+	u32 max_inputs = ARRAY_SIZE(bench_formats) * ARRAY_SIZE(bench_refclks) *
+			 BENCH_LANES * BENCH_LINK_FREQS *
+			 ARRAY_SIZE(bench_pclks) * ARRAY_SIZE(bench_widths) *
+			 ARRAY_SIZE(bench_hblanks);
+	struct tc358746_input *inputs;
+	struct bench_stage *stages;
+	struct tc358746_ctx ctx;
+	u32 n, n_pll, n_lane, n_tx, i;
+	u64 best, start, ns, ok;
+	int rep;
+
+	if (repeats < 1) {
+		fprintf(stderr, "usage: %s [repeats]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	inputs = calloc(max_inputs, sizeof(*inputs));
+	stages = calloc(max_inputs, sizeof(*stages));
+	if (!inputs || !stages) {
+		perror("calloc");
+		return EXIT_FAILURE;
+	}
+
+	n = build_sweep(inputs);
+
+	fprintf(stdout, "name,calls,ok,ns_per_call,calls_per_s\n");
+
+/* run 'body' over 'count' items 'repeats' times, keep the fastest run */
+#define BENCH(name, count, body)					\
+	do {								\
+		best = ~0ULL;						\
+		for (rep = 0; rep < repeats; rep++) {			\
+			ok = 0;						\
+			start = now_ns();				\
+			for (i = 0; i < (count); i++) {			\
+				body;					\
+			}						\
+			ns = now_ns() - start;				\
+			if (ns < best)					\
+				best = ns;				\
+		}							\
+		report(name, count, ok, best);				\
+	} while (0)
+
+	BENCH("get_format", n, {
+		const struct tc358746_mbus_fmt *format;
+
+		format = tc358746_get_format(inputs[i].mbus_fmt);
+		ok += format != NULL;
+		bench_sink += (uintptr_t)format;
+	});
+
+	BENCH("setup_pll", n, {
+		struct tc358746_pll pll;
+		struct tc358746_csi csi;
+
+		if (tc358746_setup_pll(inputs + i, &pll, &csi, NULL) == 0) {
+			ok++;
+			bench_sink += pll.pll_fbd;
+		}
+	});
+
+	for (i = 0, n_pll = 0; i < n; i++) {
+		struct bench_stage *s = stages + n_pll;
+
+		s->input = inputs + i;
+		s->format = tc358746_get_format(inputs[i].mbus_fmt);
+		if (tc358746_setup_pll(s->input, &s->pll, &s->csi, NULL) == 0)
+			n_pll++;
+	}
+
+	BENCH("set_lane_settings", n_pll, {
+		struct tc358746_csi csi = stages[i].csi;
+
+		if (tc358746_set_lane_settings(stages[i].input, &stages[i].pll,
+					       &csi, NULL) == 0) {
+			ok++;
+			bench_sink += csi.unit_clk_mul;
+		}
+	});
+
+	for (i = 0, n_lane = 0; i < n_pll; i++)
+		if (tc358746_set_lane_settings(stages[i].input, &stages[i].pll,
+					       &stages[i].csi, NULL) == 0)
+			stages[n_lane++] = stages[i];
+
+	BENCH("calculate_csi_txtimings", n_lane, {
+		struct tc358746_csi csi = stages[i].csi;
+
+		if (tc358746_calculate_csi_txtimings(stages[i].input,
+						     &csi, NULL) == 0) {
+			ok++;
+			bench_sink += csi.csi_hs_lp_hs_ps;
+		}
+	});
+
+	for (i = 0, n_tx = 0; i < n_lane; i++)
+		if (tc358746_calculate_csi_txtimings(stages[i].input,
+						     &stages[i].csi, NULL) == 0)
+			stages[n_tx++] = stages[i];
+
+	BENCH("adjust_fifo_size", n_tx, {
+		u16 fifo;
+
+		if (tc358746_adjust_fifo_size(stages[i].input,
+					      stages[i].format,
+					      &stages[i].csi, &fifo,
+					      NULL) == 0) {
+			ok++;
+			bench_sink += fifo;
+		}
+	});
+
+	BENCH("calculate", n, {
+		struct tc358746 param;
+
+		if (tc358746_calculate(&param, inputs + i) == 0) {
+			ok++;
+			bench_sink += param.vb_fifo;
+		}
+	});
+
+	/* the sweep varies the hblank fastest, then width and pclk */
+	tc358746_ctx_init(&ctx);
+	BENCH("ctx_calculate", n, {
+		struct tc358746 param;
+
+		if (tc358746_ctx_calculate(&ctx, &param, inputs + i,
+					   NULL) == 0) {
+			ok++;
+			bench_sink += param.vb_fifo;
+		}
+	});
+
+	BENCH("find_link_freq", n / BENCH_FIND_STRIDE, {
+		struct tc358746 param;
+		u64 link_freq;
+
+		if (tc358746_find_link_freq(&param,
+					    inputs + i * BENCH_FIND_STRIDE,
+					    1000, &link_freq) == 0) {
+			ok++;
+			bench_sink += link_freq;
+		}
+	});
+
+	free(stages);
+	free(inputs);
+
+	return EXIT_SUCCESS;
+}
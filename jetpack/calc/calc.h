@@ -0,0 +1,34 @@
+#ifndef CALC_H
+#define CALC_H
+
+#include <stdint.h>
+
+/* xorshift64* pseudo random generator, reproducible across hosts */
+static inline uint64_t calc_rand(uint64_t *state)
+{
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 0x2545f4914f6cdd1dULL;
+}
+
+/* uniform random value in [lo, hi] */
+static inline uint64_t calc_rand_range(uint64_t *state, uint64_t lo,
+				       uint64_t hi)
+{
+	return lo + calc_rand(state) % (hi - lo + 1);
+}
+
+/* short format names of the explore and plan commands, e.g. "raw14" */
+uint32_t calc_format_code(const char *name);
+const char *calc_format_name(uint32_t code);
+
+int verify_fifo(int argc, char *argv[]);
+int verify_ctx(int argc, char *argv[]);
+int verify_batch(int argc, char *argv[]);
+int verify_link(int argc, char *argv[]);
+int verify_program(int argc, char *argv[]);
+int explore(int argc, char *argv[]);
+int simulate(int argc, char *argv[]);
+
+#endif
@@ -0,0 +1,693 @@
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "calc.h"
+#include "tc358746_calculation.h"
+#include <linux/math.h>
+#include <linux/minmax.h>
+#include <uapi/linux/media-bus-format.h>
+
+/*
+ * Parallel design space explorer. The grid format x refclk x lanes x clock
+ * mode x link frequency x pclk x hblank is numbered in mixed radix, every
+ * worker starts with an equal slice of the numbers and takes chunks from the
+ * front of it. A worker that runs dry steals the back half of the largest
+ * remaining slice, so uneven slices (infeasible regions are cheap) don't
+ * leave cores idle.
+ */
+
+#define EXPLORE_CHUNK		4096
+#define EXPLORE_BUF_SIZE	65536
+
+struct explore_format {
+	const char *name;
+	u32 code;
+};
+
+static const struct explore_format explore_formats[] = {
+	{ "uyvy8_2x8", MEDIA_BUS_FMT_UYVY8_2X8 },
+	{ "uyvy8_1x16", MEDIA_BUS_FMT_UYVY8_1X16 },
+	{ "yuyv8_1x16", MEDIA_BUS_FMT_YUYV8_1X16 },
+	{ "uyvy10_2x10", MEDIA_BUS_FMT_UYVY10_2X10 },
+	{ "gbr888", MEDIA_BUS_FMT_GBR888_1X24 },
+	{ "rgb888", MEDIA_BUS_FMT_RGB888_1X24 },
+	{ "raw8", MEDIA_BUS_FMT_SRGGB8_1X8 },
+	{ "raw10", MEDIA_BUS_FMT_SRGGB10_1X10 },
+	{ "raw12", MEDIA_BUS_FMT_SRGGB12_1X12 },
+	{ "raw14", MEDIA_BUS_FMT_SRGGB14_1X14 },
+};
+
+/* lo, lo + step, ... <= hi */
+struct explore_axis {
+	u64 lo, hi, step;
+};
+
+enum explore_rank {
+	EXPLORE_RANK_LINK,	/* lane rate, then fifo, then overhead */
+	EXPLORE_RANK_FIFO,	/* fifo, then lane rate, then overhead */
+	EXPLORE_RANK_OVERHEAD,	/* line overhead, then lane rate, then fifo */
+};
+
+struct explore_result {
+	u64 index;
+	struct tc358746_input input;
+	u32 lane_rate;
+	u16 vb_fifo;
+	u64 hs_lp_hs_ps;
+	u32 overhead;		/* non payload share of the line, 0.01 % */
+};
+
+struct explore_range {
+	pthread_mutex_t lock;
+	u64 begin, end;
+};
+
+struct explore;
+
+struct explore_worker {
+	struct explore *ex;
+	pthread_t thread;
+	u32 id;
+	struct explore_range range;
+	struct explore_result *top;
+	u32 top_num;
+	u64 feasible;
+	char *buf;
+	size_t buf_len;
+};
+
+struct explore {
+	u32 formats[ARRAY_SIZE(explore_formats)];
+	u32 formats_num;
+	struct explore_axis refclk, lanes, clock, link, pclk, hblank;
+	u32 width;
+	u64 total;
+
+	enum explore_rank rank;
+	u32 top_max;
+	bool all;
+	bool json;
+	FILE *fp;
+	pthread_mutex_t out_lock;
+	bool out_first;
+
+	u32 workers_num;
+	struct explore_worker *workers;
+};
+
+static u64 axis_len(const struct explore_axis *axis)
+{
+	return (axis->hi - axis->lo) / axis->step + 1;
+}
+
+static int parse_axis(const char *arg, struct explore_axis *axis)
+{
+	char *end;
+
+	axis->lo = strtoull(arg, &end, 0);
+	axis->hi = axis->lo;
+	axis->step = 1;
+
+	if (*end == ':')
+		axis->hi = strtoull(end + 1, &end, 0);
+	if (*end == ':')
+		axis->step = strtoull(end + 1, &end, 0);
+
+	if (*end || !axis->step || axis->hi < axis->lo) {
+		fprintf(stderr, "invalid range '%s', expected lo[:hi[:step]]\n",
+			arg);
+		return -1;
+	}
+
+	return 0;
+}
+
+u32 calc_format_code(const char *name)
+{
+	u32 i;
+
+	for (i = 0; i < ARRAY_SIZE(explore_formats); i++)
+		if (!strcmp(name, explore_formats[i].name))
+			return explore_formats[i].code;
+
+	return 0;
+}
+
+const char *calc_format_name(u32 code)
+{
+	u32 i;
+
+	for (i = 0; i < ARRAY_SIZE(explore_formats); i++)
+		if (explore_formats[i].code == code)
+			return explore_formats[i].name;
+
+	return "???";
+}
+
+static int parse_formats(const char *arg, struct explore *ex)
+{
+	char *list = strdup(arg), *save, *name;
+	u32 code;
+
+	ex->formats_num = 0;
+	for (name = strtok_r(list, ",", &save); name;
+	     name = strtok_r(NULL, ",", &save)) {
+		code = calc_format_code(name);
+		if (!code || ex->formats_num == ARRAY_SIZE(ex->formats)) {
+			fprintf(stderr, "unknown format '%s'\n", name);
+			free(list);
+			return -1;
+		}
+
+		ex->formats[ex->formats_num++] = code;
+	}
+
+	free(list);
+	return ex->formats_num ? 0 : -1;
+}
+
+/* grid number to input, hblank runs fastest */
+static void explore_input(const struct explore *ex, u64 index,
+			  struct tc358746_input *input)
+{
+	const struct explore_axis *axes[] = {
+		&ex->hblank, &ex->pclk, &ex->link, &ex->clock, &ex->lanes,
+		&ex->refclk,
+	};
+	u64 values[ARRAY_SIZE(axes)];
+	u32 i;
+
+	for (i = 0; i < ARRAY_SIZE(axes); i++) {
+		u64 len = axis_len(axes[i]);
+
+		values[i] = axes[i]->lo + index % len * axes[i]->step;
+		index /= len;
+	}
+
+	memset(input, 0, sizeof(*input));
+	input->hblank = values[0];
+	input->pclk = values[1];
+	input->link_frequency = values[2];
+	input->discontinuous_clk = values[3];
+	input->num_lanes = values[4];
+	input->refclk = values[5];
+	input->mbus_fmt = ex->formats[index];
+	input->width = ex->width;
+}
+
+static int compare_results(const struct explore *ex,
+			   const struct explore_result *a,
+			   const struct explore_result *b)
+{
+	u64 ka[3], kb[3];
+	u32 i;
+
+	switch (ex->rank) {
+	case EXPLORE_RANK_FIFO:
+		ka[0] = a->vb_fifo; ka[1] = a->lane_rate; ka[2] = a->overhead;
+		kb[0] = b->vb_fifo; kb[1] = b->lane_rate; kb[2] = b->overhead;
+		break;
+	case EXPLORE_RANK_OVERHEAD:
+		ka[0] = a->overhead; ka[1] = a->lane_rate; ka[2] = a->vb_fifo;
+		kb[0] = b->overhead; kb[1] = b->lane_rate; kb[2] = b->vb_fifo;
+		break;
+	default:
+		ka[0] = a->lane_rate; ka[1] = a->vb_fifo; ka[2] = a->overhead;
+		kb[0] = b->lane_rate; kb[1] = b->vb_fifo; kb[2] = b->overhead;
+		break;
+	}
+
+	for (i = 0; i < ARRAY_SIZE(ka); i++)
+		if (ka[i] != kb[i])
+			return ka[i] < kb[i] ? -1 : 1;
+
+	/* the grid number keeps the ranking independent of the scheduling */
+	return a->index < b->index ? -1 : a->index > b->index;
+}
+
+/* keep the best top_max results sorted, worst last */
+static void explore_rank(struct explore_worker *w,
+			 const struct explore_result *res)
+{
+	struct explore *ex = w->ex;
+	u32 pos;
+
+	if (w->top_num == ex->top_max &&
+	    (!ex->top_max ||
+	     compare_results(ex, res, w->top + w->top_num - 1) >= 0))
+		return;
+
+	if (w->top_num < ex->top_max)
+		w->top_num++;
+
+	for (pos = w->top_num - 1;
+	     pos > 0 && compare_results(ex, res, w->top + pos - 1) < 0; pos--)
+		w->top[pos] = w->top[pos - 1];
+	w->top[pos] = *res;
+}
+
+static int format_result(const struct explore *ex,
+			 const struct explore_result *res,
+			 char *buf, size_t size)
+{
+	const struct tc358746_input *in = &res->input;
+
+	if (ex->json)
+		return snprintf(buf, size,
+			"{\"format\":\"%s\",\"refclk\":%u,\"lanes\":%d,"
+			"\"clock\":\"%s\",\"link_frequency\":%lu,"
+			"\"lane_rate\":%u,\"pclk\":%u,\"width\":%u,"
+			"\"hblank\":%u,\"vb_fifo\":%u,\"hs_lp_hs_ps\":%lu,"
+			"\"overhead\":%u.%02u}",
+			calc_format_name(in->mbus_fmt), in->refclk, in->num_lanes,
+			in->discontinuous_clk ? "discontinuous" : "continuous",
+			in->link_frequency, res->lane_rate, in->pclk,
+			in->width, in->hblank, res->vb_fifo, res->hs_lp_hs_ps,
+			res->overhead / 100, res->overhead % 100);
+
+	return snprintf(buf, size, "%s,%u,%d,%s,%lu,%u,%u,%u,%u,%u,%lu,%u.%02u\n",
+			calc_format_name(in->mbus_fmt), in->refclk, in->num_lanes,
+			in->discontinuous_clk ? "discontinuous" : "continuous",
+			in->link_frequency, res->lane_rate, in->pclk,
+			in->width, in->hblank, res->vb_fifo, res->hs_lp_hs_ps,
+			res->overhead / 100, res->overhead % 100);
+}
+
+static void explore_write(struct explore *ex, const char *buf, size_t len)
+{
+	pthread_mutex_lock(&ex->out_lock);
+	fwrite(buf, 1, len, ex->fp);
+	pthread_mutex_unlock(&ex->out_lock);
+}
+
+static void explore_stream(struct explore_worker *w,
+			   const struct explore_result *res)
+{
+	char line[512];
+	int len = format_result(w->ex, res, line, sizeof(line));
+
+	if (w->ex->json) {
+		/* the separators need the global order, write directly */
+		pthread_mutex_lock(&w->ex->out_lock);
+		fprintf(w->ex->fp, "%s\n  %s", w->ex->out_first ? "" : ",",
+			line);
+		w->ex->out_first = false;
+		pthread_mutex_unlock(&w->ex->out_lock);
+		return;
+	}
+
+	if (w->buf_len + len > EXPLORE_BUF_SIZE) {
+		explore_write(w->ex, w->buf, w->buf_len);
+		w->buf_len = 0;
+	}
+
+	memcpy(w->buf + w->buf_len, line, len);
+	w->buf_len += len;
+}
+
+static bool take_chunk(struct explore_range *range, u64 *begin, u64 *end)
+{
+	bool ok;
+
+	pthread_mutex_lock(&range->lock);
+	ok = range->begin < range->end;
+	if (ok) {
+		*begin = range->begin;
+		*end = min_t(u64, range->begin + EXPLORE_CHUNK, range->end);
+		range->begin = *end;
+	}
+	pthread_mutex_unlock(&range->lock);
+
+	return ok;
+}
+
+/* move the back half of the largest other range into our own, empty one */
+static bool steal(struct explore_worker *w)
+{
+	struct explore *ex = w->ex;
+	struct explore_worker *victim = NULL;
+	u64 best = 0, begin, end;
+	u32 i;
+
+	for (i = 0; i < ex->workers_num; i++) {
+		struct explore_range *range = &ex->workers[i].range;
+		u64 left;
+
+		if (i == w->id)
+			continue;
+
+		pthread_mutex_lock(&range->lock);
+		left = range->end - range->begin;
+		pthread_mutex_unlock(&range->lock);
+
+		if (left > best) {
+			best = left;
+			victim = ex->workers + i;
+		}
+	}
+
+	if (!victim)
+		return false;
+
+	pthread_mutex_lock(&victim->range.lock);
+	begin = victim->range.begin;
+	end = victim->range.end;
+	if (end - begin > EXPLORE_CHUNK)
+		begin += (end - begin) / 2;
+	victim->range.end = begin;
+	pthread_mutex_unlock(&victim->range.lock);
+
+	if (begin == end)
+		return true;	/* lost a race, look again */
+
+	pthread_mutex_lock(&w->range.lock);
+	w->range.begin = begin;
+	w->range.end = end;
+	pthread_mutex_unlock(&w->range.lock);
+
+	return true;
+}
+
+static void *explore_worker(void *arg)
+{
+	struct explore_worker *w = arg;
+	struct explore *ex = w->ex;
+	struct tc358746_ctx ctx;
+	u64 begin, end, index;
+
+	/* hblank runs fastest, mostly only the fifo is calculated again */
+	tc358746_ctx_init(&ctx);
+
+	for (;;) {
+		if (!take_chunk(&w->range, &begin, &end)) {
+			if (!steal(w))
+				break;
+			continue;
+		}
+
+		for (index = begin; index < end; index++) {
+			struct explore_result res;
+			struct tc358746_frame frame;
+			struct tc358746 param;
+
+			explore_input(ex, index, &res.input);
+			if (tc358746_ctx_calculate(&ctx, &param, &res.input,
+						   NULL) < 0)
+				continue;
+
+			/* one line without vblank gives the line budget */
+			res.input.height = 1;
+			if (tc358746_frame_timing(&param, &res.input, &frame) < 0)
+				continue;
+			res.input.height = 0;
+
+			res.index = index;
+			res.lane_rate = param.csi.speed_per_lane;
+			res.vb_fifo = param.vb_fifo;
+			res.hs_lp_hs_ps = param.csi.csi_hs_lp_hs_ps;
+			res.overhead = frame.link_utilisation < 10000 ?
+				       10000 - frame.link_utilisation : 0;
+
+			w->feasible++;
+			if (ex->all)
+				explore_stream(w, &res);
+			explore_rank(w, &res);
+		}
+	}
+
+	if (w->buf_len)
+		explore_write(ex, w->buf, w->buf_len);
+
+	return NULL;
+}
+
+static void explore_usage(void)
+{
+	u32 i;
+
+	fprintf(stderr,
+		"usage: calc explore [options]\n"
+		"  -w, --width N          active width (640)\n"
+		"  -f, --formats LIST     comma separated, of:");
+	for (i = 0; i < ARRAY_SIZE(explore_formats); i++)
+		fprintf(stderr, " %s", explore_formats[i].name);
+	fprintf(stderr,
+		"\n"
+		"  -R, --refclk RANGE     Hz (24000000)\n"
+		"  -l, --lanes RANGE      (1:4)\n"
+		"  -c, --clock RANGE      0 continuous, 1 discontinuous (0:1)\n"
+		"  -L, --link RANGE       Hz (31250000:500000000:1000000)\n"
+		"  -p, --pclk RANGE       Hz (10000000:150000000:1000000)\n"
+		"  -b, --hblank RANGE     pixels (16:1024:8)\n"
+		"  -r, --rank KEY         link, fifo or overhead (link)\n"
+		"  -n, --top N            ranked results to print (20)\n"
+		"  -a, --all              stream every feasible configuration\n"
+		"  -J, --json             JSON instead of CSV\n"
+		"  -o, --output FILE      instead of stdout\n"
+		"  -j, --jobs N           worker threads (online cpus)\n"
+		"RANGE is lo[:hi[:step]]\n");
+}
+
+/*
+ * usage: calc explore [options], see explore_usage()
+ */
+int explore(int argc, char *argv[])
+{
+	static const struct option options[] = {
+		{ "width", required_argument, NULL, 'w' },
+		{ "formats", required_argument, NULL, 'f' },
+		{ "refclk", required_argument, NULL, 'R' },
+		{ "lanes", required_argument, NULL, 'l' },
+		{ "clock", required_argument, NULL, 'c' },
+		{ "link", required_argument, NULL, 'L' },
+		{ "pclk", required_argument, NULL, 'p' },
+		{ "hblank", required_argument, NULL, 'b' },
+		{ "rank", required_argument, NULL, 'r' },
+		{ "top", required_argument, NULL, 'n' },
+		{ "all", no_argument, NULL, 'a' },
+		{ "json", no_argument, NULL, 'J' },
+		{ "output", required_argument, NULL, 'o' },
+		{ "jobs", required_argument, NULL, 'j' },
+		{ "help", no_argument, NULL, 'h' },
+		{ },
+	};
+	struct explore ex = {
+		.refclk = { 24000000, 24000000, 1 },
+		.lanes = { 1, 4, 1 },
+		.clock = { 0, 1, 1 },
+		.link = { 31250000, 500000000, 1000000 },
+		.pclk = { 10000000, 150000000, 1000000 },
+		.hblank = { 16, 1024, 8 },
+		.width = 640,
+		.rank = EXPLORE_RANK_LINK,
+		.top_max = 20,
+		.fp = stdout,
+		.out_first = true,
+		.workers_num = sysconf(_SC_NPROCESSORS_ONLN),
+	};
+	struct explore_result *top;
+	struct timespec start, stop;
+	u64 feasible = 0, slice;
+	u32 top_num = 0, i;
+	double secs;
+	int opt, ret = EXIT_SUCCESS;
+
+	/* argv[0] is the first argument, getopt skips it */
+	argc++;
+	argv--;
+	optind = 1;
+
+	for (i = 0; i < ARRAY_SIZE(explore_formats); i++)
+		ex.formats[i] = explore_formats[i].code;
+	ex.formats_num = ARRAY_SIZE(explore_formats);
+
+	while ((opt = getopt_long(argc, argv, "w:f:R:l:c:L:p:b:r:n:aJo:j:h",
+				  options, NULL)) != -1) {
+		int err = 0;
+
+		switch (opt) {
+		case 'w':
+			ex.width = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			err = parse_formats(optarg, &ex);
+			break;
+		case 'R':
+			err = parse_axis(optarg, &ex.refclk);
+			break;
+		case 'l':
+			err = parse_axis(optarg, &ex.lanes);
+			break;
+		case 'c':
+			err = parse_axis(optarg, &ex.clock);
+			if (!err && ex.clock.hi > 1)
+				err = -1;
+			break;
+		case 'L':
+			err = parse_axis(optarg, &ex.link);
+			break;
+		case 'p':
+			err = parse_axis(optarg, &ex.pclk);
+			break;
+		case 'b':
+			err = parse_axis(optarg, &ex.hblank);
+			break;
+		case 'r':
+			if (!strcmp(optarg, "link"))
+				ex.rank = EXPLORE_RANK_LINK;
+			else if (!strcmp(optarg, "fifo"))
+				ex.rank = EXPLORE_RANK_FIFO;
+			else if (!strcmp(optarg, "overhead"))
+				ex.rank = EXPLORE_RANK_OVERHEAD;
+			else
+				err = -1;
+			break;
+		case 'n':
+			ex.top_max = strtoul(optarg, NULL, 0);
+			break;
+		case 'a':
+			ex.all = true;
+			break;
+		case 'J':
+			ex.json = true;
+			break;
+		case 'o':
+			ex.fp = fopen(optarg, "w");
+			if (!ex.fp) {
+				perror(optarg);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'j':
+			ex.workers_num = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			err = -1;
+			break;
+		}
+
+		if (err) {
+			explore_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!ex.workers_num)
+		ex.workers_num = 1;
+
+	ex.total = ex.formats_num * axis_len(&ex.refclk) *
+		   axis_len(&ex.lanes) * axis_len(&ex.clock) *
+		   axis_len(&ex.link) * axis_len(&ex.pclk) *
+		   axis_len(&ex.hblank);
+
+	ex.workers = calloc(ex.workers_num, sizeof(*ex.workers));
+	top = calloc(ex.top_max * ex.workers_num + 1, sizeof(*top));
+	if (!ex.workers || !top) {
+		perror("calloc");
+		return EXIT_FAILURE;
+	}
+
+	pthread_mutex_init(&ex.out_lock, NULL);
+
+	if (ex.all && !ex.json)
+		fprintf(ex.fp, "format,refclk,lanes,clock,link_frequency,"
+			"lane_rate,pclk,width,hblank,vb_fifo,hs_lp_hs_ps,"
+			"overhead\n");
+	else if (ex.all)
+		fprintf(ex.fp, "{\n\"feasible\": [");
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	slice = DIV_ROUND_UP(ex.total, ex.workers_num);
+	for (i = 0; i < ex.workers_num; i++) {
+		struct explore_worker *w = ex.workers + i;
+
+		w->ex = &ex;
+		w->id = i;
+		w->range.begin = min_t(u64, i * slice, ex.total);
+		w->range.end = min_t(u64, w->range.begin + slice, ex.total);
+		pthread_mutex_init(&w->range.lock, NULL);
+		w->top = calloc(ex.top_max + 1, sizeof(*w->top));
+		w->buf = malloc(EXPLORE_BUF_SIZE);
+		if (!w->top || !w->buf) {
+			perror("calloc");
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (i = 0; i < ex.workers_num; i++)
+		if (pthread_create(&ex.workers[i].thread, NULL, explore_worker,
+				   ex.workers + i)) {
+			perror("pthread_create");
+			return EXIT_FAILURE;
+		}
+
+	for (i = 0; i < ex.workers_num; i++)
+		pthread_join(ex.workers[i].thread, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+	secs = (stop.tv_sec - start.tv_sec) +
+	       (stop.tv_nsec - start.tv_nsec) / 1e9;
+
+	/* merge the per worker rankings */
+	for (i = 0; i < ex.workers_num; i++) {
+		struct explore_worker *w = ex.workers + i;
+		u32 j;
+
+		feasible += w->feasible;
+		for (j = 0; j < w->top_num; j++) {
+			u32 pos = top_num++;
+
+			while (pos > 0 &&
+			       compare_results(&ex, w->top + j, top + pos - 1) < 0) {
+				top[pos] = top[pos - 1];
+				pos--;
+			}
+			top[pos] = w->top[j];
+		}
+	}
+	top_num = min(top_num, ex.top_max);
+
+	if (ex.json) {
+		fprintf(ex.fp, "%s\"ranked\": [", ex.all ? "\n],\n" : "{\n");
+		for (i = 0; i < top_num; i++) {
+			char line[512];
+
+			format_result(&ex, top + i, line, sizeof(line));
+			fprintf(ex.fp, "%s\n  %s", i ? "," : "", line);
+		}
+		fprintf(ex.fp, "\n]\n}\n");
+	} else {
+		if (ex.all)
+			fprintf(ex.fp, "\n");
+		fprintf(ex.fp, "rank,format,refclk,lanes,clock,link_frequency,"
+			"lane_rate,pclk,width,hblank,vb_fifo,hs_lp_hs_ps,"
+			"overhead\n");
+		for (i = 0; i < top_num; i++) {
+			char line[512];
+
+			format_result(&ex, top + i, line, sizeof(line));
+			fprintf(ex.fp, "%u,%s", i + 1, line);
+		}
+	}
+
+	fprintf(stderr, "explore: %lu configurations, %lu feasible, %u threads, "
+		"%.2f s, %.0f configurations/s\n", ex.total, feasible,
+		ex.workers_num, secs, secs > 0 ? ex.total / secs : 0.0);
+
+	if (ex.fp != stdout && fclose(ex.fp))
+		ret = EXIT_FAILURE;
+
+	for (i = 0; i < ex.workers_num; i++) {
+		free(ex.workers[i].top);
+		free(ex.workers[i].buf);
+	}
+	free(ex.workers);
+	free(top);
+
+	return ret;
+}
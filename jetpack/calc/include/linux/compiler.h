@@ -0,0 +1,13 @@
+#ifndef _LINUX_COMPILER_H
+#define _LINUX_COMPILER_H
+
+#define ___PASTE(a, b) a##b
+#define __PASTE(a, b) ___PASTE(a, b)
+
+#define __UNIQUE_ID(prefix) __PASTE(__PASTE(__UNIQUE_ID_, prefix), __COUNTER__)
+
+#define __maybe_unused __attribute__((__unused__))
+
+#define BUILD_BUG_ON_ZERO(e) ((int)(sizeof(struct { int:(-!!(e)); })))
+
+#endif
@@ -0,0 +1,9 @@
+#ifndef _LINUX_DELAY_H
+#define _LINUX_DELAY_H
+
+static inline void udelay(unsigned long usecs)
+{
+	(void)usecs;
+}
+
+#endif
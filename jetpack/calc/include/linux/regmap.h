@@ -0,0 +1,18 @@
+#ifndef _LINUX_REGMAP_H
+#define _LINUX_REGMAP_H
+
+#include <stddef.h>
+
+/* implemented by the recording regmap of the host tools, see regmap_mock.h */
+struct regmap;
+
+int regmap_read(struct regmap *map, unsigned int reg, unsigned int *val);
+int regmap_write(struct regmap *map, unsigned int reg, unsigned int val);
+int regmap_update_bits(struct regmap *map, unsigned int reg,
+		       unsigned int mask, unsigned int val);
+int regmap_bulk_write(struct regmap *map, unsigned int reg, const void *val,
+		      size_t val_count);
+int regcache_drop_region(struct regmap *map, unsigned int min,
+			 unsigned int max);
+
+#endif
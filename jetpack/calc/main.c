@@ -1,8 +1,11 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include "calc.h"
 #include "tc358746_calculation.h"
+#include "tc358746_program.h"
 #include "tc358746_regs.h"
+#include <linux/compiler.h>
 #include <uapi/linux/media-bus-format.h>
 
 static const struct tc358746_input inputs[] = {
@@ -15,6 +18,8 @@ static const struct tc358746_input inputs[] = {
 		.pclk = 20000000,
 		.width = 640,
 		.hblank = 54,/* TODO: 44 would be better??? */
+		.height = 480,
+		.framerate = 60020000,		/* default_framerate */
 	},
 	{
 		.mbus_fmt = MEDIA_BUS_FMT_RGB888_1X24,
@@ -25,6 +30,8 @@ static const struct tc358746_input inputs[] = {
 		.pclk = 83000000,
 		.width = 1280,
 		.hblank = 54,
+		.height = 1024,
+		.framerate = 60756000,		/* default_framerate */
 	},
 	{
 		.mbus_fmt = MEDIA_BUS_FMT_RGB888_1X24,
@@ -35,6 +42,8 @@ static const struct tc358746_input inputs[] = {
 		.pclk = 20000000,
 		.width = 320,
 		.hblank = 1084,
+		.height = 240,
+		.framerate = 60020000,		/* default_framerate */
 	},
 	{
 		.mbus_fmt = MEDIA_BUS_FMT_RGB888_1X24,
@@ -45,9 +54,14 @@ static const struct tc358746_input inputs[] = {
 		.pclk = 83000000,
 		.width = 1024,
 		.hblank = 55,
+		.height = 768,
+		.framerate = 60756000,		/* default_framerate */
 	},
 };
 
+/* granularity of the link frequencies found by find_lowest_link_freq() */
+#define LINK_FREQ_RESOLUTION	1000
+
 #define bool_str(val) ((val) ? "true" : "false")
 #define add_case(code) case code: return #code
 
@@ -191,6 +205,17 @@ static const char *pdataf_to_str(u8 code)
 	}
 }
 
+static const char *hs_lp_hs_model_to_str(enum tc358746_hs_lp_hs_model model)
+{
+	switch (model) {
+		add_case(TC358746_HS_LP_HS_LEGACY);
+		add_case(TC358746_HS_LP_HS_EXACT);
+
+		default:
+			return "???";
+	}
+}
+
 static const char *speed_range_to_str(u8 speed_range)
 {
 	switch (speed_range) {
@@ -207,9 +232,9 @@ static const char *speed_range_to_str(u8 speed_range)
 	}
 }
 
-void tc358746_input_dump(const struct tc358746_input *self)
+void tc358746_input_dump(FILE *fp, const struct tc358746_input *self)
 {
-	fprintf(stdout,
+	fprintf(fp,
 		"\t\t/* config %u */\n"
 		"\t\t.input = {\n"
 		"\t\t\t.mbus_fmt = %s,\n"
@@ -217,9 +242,14 @@ void tc358746_input_dump(const struct tc358746_input *self)
 		"\t\t\t.link_frequency = %lu,\t\t/* Hz */\n"
 		"\t\t\t.num_lanes = %u,\n"
 		"\t\t\t.discontinuous_clk = %s,\n"
+		"\t\t\t.hs_lp_hs_model = %s,\n"
+		"\t\t\t.hs_lp_hs_margin = %u,\t\t/* %% */\n"
 		"\t\t\t.pclk = %u,\t\t\t/* Hz */\n"
 		"\t\t\t.width = %u,\n"
 		"\t\t\t.hblank = %u,\n"
+		"\t\t\t.height = %u,\n"
+		"\t\t\t.vblank = %u,\n"
+		"\t\t\t.framerate = %u,\t\t/* fps * 1000000 */\n"
 		"\t\t},\n",
 		self->width,
 		mbus_fmt_to_str(self->mbus_fmt),
@@ -227,14 +257,19 @@ void tc358746_input_dump(const struct tc358746_input *self)
 		self->link_frequency,
 		self->num_lanes,
 		bool_str(self->discontinuous_clk),
+		hs_lp_hs_model_to_str(self->hs_lp_hs_model),
+		self->hs_lp_hs_margin,
 		self->pclk,
 		self->width,
-		self->hblank);
+		self->hblank,
+		self->height,
+		self->vblank,
+		self->framerate);
 }
 
-void tc358746_mbus_fmt_dump(const struct tc358746_mbus_fmt *self)
+void tc358746_mbus_fmt_dump(FILE *fp, const struct tc358746_mbus_fmt *self)
 {
-	fprintf(stdout,
+	fprintf(fp,
 		"\t\t.format = {\n"
 		"\t\t\t.code = %s,\n"
 		"\t\t\t.bus_width = %u,\n"
@@ -253,9 +288,9 @@ void tc358746_mbus_fmt_dump(const struct tc358746_mbus_fmt *self)
 		bool_str(self->csitx_only));
 }
 
-void tc358746_pll_dump(const struct tc358746_pll *self)
+void tc358746_pll_dump(FILE *fp, const struct tc358746_pll *self)
 {
-	fprintf(stdout,
+	fprintf(fp,
 		"\t\t.pll = {\n"
 		"\t\t\t.pllinclk_hz = %u,\n"
 		"\t\t\t.pll_prd = %u,\n"
@@ -266,9 +301,9 @@ void tc358746_pll_dump(const struct tc358746_pll *self)
 		self->pll_fbd);
 }
 
-void tc358746_csi_dump(const struct tc358746_csi *self)
+void tc358746_csi_dump(FILE *fp, const struct tc358746_csi *self)
 {
-	fprintf(stdout,
+	fprintf(fp,
 		"\t\t.csi = {\n"
 		"\t\t\t.speed_range = %u,\t\t\t/* %s */\n"
 		"\t\t\t.unit_clk_hz = %u,\n"
@@ -289,7 +324,7 @@ void tc358746_csi_dump(const struct tc358746_csi *self)
 		"\t\t\t.ths_zerocnt = %u,\n"
 		"\t\t\t.ths_trailcnt = %u,\n"
 		"\n"
-		"\t\t\t.csi_hs_lp_hs_ps = %u,\t\t/* %u us */\n"
+		"\t\t\t.csi_hs_lp_hs_ps = %lu,\t\t/* %lu ns */\n"
 		"\t\t},\n",
 		self->speed_range, speed_range_to_str(self->speed_range),
 		self->unit_clk_hz,
@@ -311,22 +346,77 @@ void tc358746_csi_dump(const struct tc358746_csi *self)
 		self->csi_hs_lp_hs_ps, self->csi_hs_lp_hs_ps / 1000);
 }
 
+/* a signed picosecond value in ns with three decimals */
+#define ps_fmt		"%s%lu.%03lu ns"
+#define ps_args(val)	(val) < 0 ? "-" : "", \
+			(u64)((val) < 0 ? -(val) : (val)) / 1000, \
+			(u64)((val) < 0 ? -(val) : (val)) % 1000
+
+void tc358746_metrics_dump(FILE *fp, const struct tc358746_metrics *self)
+{
+	fprintf(fp,
+		"\t\t/*\n"
+		"\t\t * line " ps_fmt ", parallel active " ps_fmt "\n"
+		"\t\t * csi active " ps_fmt " = data " ps_fmt
+		" + fifo delay " ps_fmt "\n"
+		"\t\t * lp window " ps_fmt ", hs->lp->hs " ps_fmt "\n"
+		"\t\t * slack: hactive " ps_fmt ", htotal " ps_fmt
+		", lp " ps_fmt "\n"
+		"\t\t * link utilisation %u.%02u %%, hs lane load %u.%02u %%\n"
+		"\t\t * count margins: lineinit " ps_fmt ", lptxtime " ps_fmt
+		", twakeup " ps_fmt ",\n"
+		"\t\t *   tclk_prepare " ps_fmt ", tclk_zero " ps_fmt
+		", tclk_trail " ps_fmt ", tclk_post " ps_fmt ",\n"
+		"\t\t *   ths_prepare " ps_fmt ", ths_zero " ps_fmt
+		", ths_trail " ps_fmt "\n"
+		"\t\t */\n",
+		ps_args((s64)self->line_period_ps),
+		ps_args((s64)self->p_hactive_ps),
+		ps_args((s64)self->c_hactive_ps),
+		ps_args((s64)self->c_data_ps),
+		ps_args((s64)self->c_fifo_delay_ps),
+		ps_args((s64)self->c_lp_window_ps),
+		ps_args((s64)self->csi_hs_lp_hs_ps),
+		ps_args(self->hactive_slack_ps),
+		ps_args(self->htotal_slack_ps),
+		ps_args(self->lp_slack_ps),
+		self->link_utilisation / 100, self->link_utilisation % 100,
+		self->hs_lane_load / 100, self->hs_lane_load % 100,
+		ps_args(self->lineinit_margin_ps),
+		ps_args(self->lptxtime_margin_ps),
+		ps_args(self->twakeup_margin_ps),
+		ps_args(self->tclk_prepare_margin_ps),
+		ps_args(self->tclk_zero_margin_ps),
+		ps_args(self->tclk_trail_margin_ps),
+		ps_args(self->tclk_post_margin_ps),
+		ps_args(self->ths_prepare_margin_ps),
+		ps_args(self->ths_zero_margin_ps),
+		ps_args(self->ths_trail_margin_ps));
+}
+
 void tc358746_dump(const struct tc358746 *self,
 		   const struct tc358746_input *input)
 {
+	struct tc358746_metrics metrics;
+
 	fprintf(stdout,
 		"\t{\n");
 
 	if (input)
-		tc358746_input_dump(input);
-	tc358746_mbus_fmt_dump(self->format);
-	tc358746_pll_dump(&self->pll);
-	tc358746_csi_dump(&self->csi);
+		tc358746_input_dump(stdout, input);
+	tc358746_mbus_fmt_dump(stdout, self->format);
+	tc358746_pll_dump(stdout, &self->pll);
+	tc358746_csi_dump(stdout, &self->csi);
 
 	fprintf(stdout,
-		"\t\t.vb_fifo = %u,\n"
-		"\t},\n",
+		"\t\t.vb_fifo = %u,\n",
 		self->vb_fifo);
+
+	if (input && tc358746_get_metrics(self, input, &metrics) == 0)
+		tc358746_metrics_dump(stdout, &metrics);
+
+	fprintf(stdout,
+		"\t},\n");
 }
 
 void put_header(void)
@@ -347,9 +437,13 @@ int try_inputs(void)
 
 	for (u32 i = 0; i < ARRAY_SIZE(inputs); i++) {
 		const struct tc358746_input *input = inputs + i;
+		struct tc358746_diag diag;
 		struct tc358746 param;
 
-		if (tc358746_calculate(&param, input) < 0) {
+		if (tc358746_calculate_diag(&param, input, &diag) < 0) {
+			fprintf(stderr, "config %u: %s, %lu vs %lu\n", i,
+				tc358746_reason_str(diag.reason), diag.value,
+				diag.bound);
 			all_ok = false;
 			continue;
 		}
@@ -372,30 +466,23 @@ int find_lowest_link_freq(void)
 	bool inputs_ok[ARRAY_SIZE(inputs)];
 	struct tc358746_input _inputs[ARRAY_SIZE(inputs)];
 	u32 link_frequencies[ARRAY_SIZE(inputs)];
-	int link_frequencies_fill = 0;
+	u32 link_frequencies_fill = 0;
 	struct tc358746 param[ARRAY_SIZE(inputs)];
 	bool all_ok;
-	int i;
+	u32 i;
 
 	for (i = 0; i < ARRAY_SIZE(inputs); i++) {
-		inputs_ok[i] = false;
-		_inputs[i] = inputs[i];
-	}
-
-	for (u32 link_freq = 1; link_freq <= 500; link_freq++) {
-		for (i = 0; i < ARRAY_SIZE(_inputs); i++) {
-			if (inputs_ok[i])
-				continue;
+		u64 link_freq;
 
-			_inputs[i].link_frequency = link_freq * 1000000;
-
-			if (tc358746_calculate(param + i, _inputs + i) < 0)
-				continue;
+		_inputs[i] = inputs[i];
+		inputs_ok[i] = tc358746_find_link_freq(param + i, _inputs + i,
+						       LINK_FREQ_RESOLUTION,
+						       &link_freq) == 0;
+		if (!inputs_ok[i])
+			continue;
 
-			link_frequencies[link_frequencies_fill++] =
-						_inputs[i].link_frequency;
-			inputs_ok[i] = true;
-		}
+		_inputs[i].link_frequency = link_freq;
+		link_frequencies[link_frequencies_fill++] = link_freq;
 	}
 
 	put_header();
@@ -415,10 +502,10 @@ int find_lowest_link_freq(void)
 	qsort(link_frequencies, link_frequencies_fill,
 	      sizeof(link_frequencies[0]), compare_freqs);
 
-	for (i = link_frequencies_fill - 1; i > 0; i--) {
-		if (link_frequencies[i] == link_frequencies[i-1]) {
-			int items = link_frequencies_fill - i - 1;
-			memmove(link_frequencies + i, link_frequencies + i + 1,
+	for (i = link_frequencies_fill; i > 1; i--) {
+		if (link_frequencies[i-1] == link_frequencies[i-2]) {
+			u32 items = link_frequencies_fill - i;
+			memmove(link_frequencies + i - 1, link_frequencies + i,
 				items * sizeof(link_frequencies[0]));
 			link_frequencies_fill--;
 		}
@@ -435,8 +522,643 @@ int find_lowest_link_freq(void)
 	return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-int main(void)
+/*
+ * Write the parameters of every input at every link frequency as a
+ * tc358746_table_entry table, the driver looks them up instead of
+ * calculating them on stream start. Infeasible combinations are left out.
+ *
+ * usage: calc header <output> <link frequency>...
+ */
+static int write_modes_header(int argc, char *argv[])
+{
+	FILE *fp;
+	u32 i;
+	int j;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: calc header <output> <link frequency>...\n");
+		return EXIT_FAILURE;
+	}
+
+	fp = fopen(argv[0], "w");
+	if (!fp) {
+		perror(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	fprintf(fp,
+		"/* SPDX-License-Identifier: GPL-2.0-only */\n"
+		"/*\n"
+		" * tc358746 parameters of the dione-ir device tree modes\n"
+		" *\n"
+		" * Generated by 'calc header', do not edit.\n"
+		" */\n"
+		"\n"
+		"#ifndef __TC358746_MODES_H\n"
+		"#define __TC358746_MODES_H\n"
+		"\n"
+		"#include <uapi/linux/media-bus-format.h>\n"
+		"#include \"tc358746_calculation.h\"\n"
+		"\n"
+		"static const struct tc358746_table_entry tc358746_modes[] = {\n");
+
+	for (i = 0; i < ARRAY_SIZE(inputs); i++) {
+		for (j = 1; j < argc; j++) {
+			struct tc358746_input input = inputs[i];
+			struct tc358746 param;
+
+			input.link_frequency = strtoull(argv[j], NULL, 0);
+			if (tc358746_calculate(&param, &input) < 0)
+				continue;
+
+			fprintf(fp, "\t{\n");
+			tc358746_input_dump(fp, &input);
+			tc358746_pll_dump(fp, &param.pll);
+			tc358746_csi_dump(fp, &param.csi);
+			fprintf(fp,
+				"\t\t.vb_fifo = %u,\n"
+				"\t},\n",
+				param.vb_fifo);
+		}
+	}
+
+	fprintf(fp,
+		"};\n"
+		"\n"
+		"#endif\n");
+
+	return fclose(fp) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#define fps_fmt		"%lu.%03lu fps"
+#define fps_args(val)	(u64)(val) / 1000000, (u64)(val) % 1000000 / 1000
+
+/*
+ * Print the frame timing of every input at its link frequency, and the
+ * lowest link frequency carrying its frame rate, or the one given in
+ * fps * 1000000.
+ *
+ * usage: calc frames [framerate]
+ */
+static int print_frames(int argc, char *argv[])
+{
+	bool all_ok = true;
+	u32 i;
+
+	for (i = 0; i < ARRAY_SIZE(inputs); i++) {
+		struct tc358746_input input = inputs[i];
+		struct tc358746_frame frame;
+		struct tc358746 param;
+		u64 link_freq;
+
+		if (argc > 0)
+			input.framerate = strtoul(argv[0], NULL, 0);
+
+		fprintf(stdout, "%ux%u %s at %lu Hz: ",
+			input.width, input.height,
+			mbus_fmt_to_str(input.mbus_fmt), input.link_frequency);
+
+		if (tc358746_calculate(&param, &input) < 0 ||
+		    tc358746_frame_timing(&param, &input, &frame) < 0) {
+			fprintf(stdout, "infeasible\n");
+			all_ok = false;
+		} else {
+			fprintf(stdout,
+				"line %lu ns, frame %lu us, " fps_fmt
+				", max " fps_fmt ", link %u.%02u%% used\n",
+				frame.line_period_ps / 1000,
+				frame.frame_period_ps / 1000000,
+				fps_args(frame.framerate),
+				fps_args(frame.max_framerate),
+				frame.link_utilisation / 100,
+				frame.link_utilisation % 100);
+		}
+
+		fprintf(stdout, "\t" fps_fmt " needs ", fps_args(input.framerate));
+		if (tc358746_find_link_freq(&param, &input, LINK_FREQ_RESOLUTION,
+					    &link_freq) < 0) {
+			fprintf(stdout, "a faster pclk than %u Hz\n", input.pclk);
+			all_ok = false;
+			continue;
+		}
+
+		fprintf(stdout, "link frequency >= %lu Hz\n", link_freq);
+	}
+
+	return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Print the smallest hblank of every input, or of every input at the pclk
+ * given in Hz, with the line time and frame rate it results in. Checks that
+ * one pixel less is infeasible.
+ *
+ * usage: calc hblank [pclk]
+ */
+static int print_min_hblank(int argc, char *argv[])
+{
+	bool all_ok = true;
+	u32 i;
+
+	for (i = 0; i < ARRAY_SIZE(inputs); i++) {
+		struct tc358746_input input = inputs[i];
+		struct tc358746_frame frame;
+		struct tc358746 param;
+		unsigned int hblank;
+
+		if (argc > 0)
+			input.pclk = strtoul(argv[0], NULL, 0);
+
+		fprintf(stdout, "%ux%u %s at %u Hz, %lu Hz: hblank %u",
+			input.width, input.height,
+			mbus_fmt_to_str(input.mbus_fmt), input.pclk,
+			input.link_frequency, input.hblank);
+
+		if (tc358746_calculate(&param, &input) == 0 &&
+		    tc358746_frame_timing(&param, &input, &frame) == 0)
+			fprintf(stdout, " (" fps_fmt ")", fps_args(frame.framerate));
+
+		if (tc358746_find_min_hblank(&param, &input, &hblank,
+					     &frame) < 0) {
+			fprintf(stdout, ", no hblank fits\n");
+			all_ok = false;
+			continue;
+		}
+
+		fprintf(stdout, ", min %u: line %lu ns, " fps_fmt "\n", hblank,
+			frame.line_period_ps / 1000, fps_args(frame.framerate));
+
+		input.hblank = hblank - 1;
+		if (hblank && tc358746_calculate(&param, &input) == 0) {
+			fprintf(stdout, "\thblank %u fits as well\n", hblank - 1);
+			all_ok = false;
+		}
+	}
+
+	return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+#define PLAN_PCLK_STEP	100000
+
+/*
+ * Plan pclk, hblank and link frequency of a mode with a frame rate in fps,
+ * a format like "raw14", see calc explore --help, and vblank lines (0). The
+ * best count (10) plans are printed, lowest lane rate and pclk first.
+ *
+ * usage: calc plan <width> <height> <fps> <format> <lanes> [vblank] [count]
+ */
+static int plan_mode(int argc, char *argv[])
+{
+	struct tc358746_input input = {
+		.refclk = 24000000,
+	};
+	struct tc358746_plan *plans;
+	unsigned int count;
+	int i, found;
+
+	if (argc < 5) {
+		fprintf(stderr, "usage: calc plan <width> <height> <fps> "
+			"<format> <lanes> [vblank] [count]\n");
+		return EXIT_FAILURE;
+	}
+
+	input.width = strtoul(argv[0], NULL, 0);
+	input.height = strtoul(argv[1], NULL, 0);
+	input.framerate = strtod(argv[2], NULL) * 1000000 + 0.5;
+	input.mbus_fmt = calc_format_code(argv[3]);
+	input.num_lanes = strtol(argv[4], NULL, 0);
+	input.vblank = argc > 5 ? strtoul(argv[5], NULL, 0) : 0;
+	count = argc > 6 ? strtoul(argv[6], NULL, 0) : 10;
+
+	if (!input.mbus_fmt || !count) {
+		fprintf(stderr, "invalid format '%s' or count\n", argv[3]);
+		return EXIT_FAILURE;
+	}
+
+	plans = calloc(count, sizeof(*plans));
+	if (!plans) {
+		perror("calloc");
+		return EXIT_FAILURE;
+	}
+
+	found = tc358746_plan(&input, PLAN_PCLK_STEP, ~0U, PLAN_PCLK_STEP,
+			      LINK_FREQ_RESOLUTION, plans, count);
+
+	fprintf(stdout, "%4s %10s %6s %6s %10s %10s %4s %11s %8s\n",
+		"rank", "pclk", "hblank", "vblank", "link[Hz]", "lane[bps]",
+		"fifo", "fps", "line[ns]");
+	for (i = 0; i < found; i++) {
+		const struct tc358746_plan *plan = plans + i;
+
+		fprintf(stdout, "%4d %10u %6u %6u %10lu %10u %4u %7lu.%03lu %8lu\n",
+			i + 1, plan->input.pclk, plan->input.hblank,
+			plan->input.vblank, plan->input.link_frequency,
+			plan->param.csi.speed_per_lane, plan->param.vb_fifo,
+			fps_args(plan->frame.framerate),
+			plan->frame.line_period_ps / 1000);
+	}
+
+	free(plans);
+
+	return found > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Choose the lane count, up to max_lanes (4), and the clock mode of every
+ * input by the lowest lane rate or the lowest power, see
+ * tc358746_find_lanes(). The lowest link frequency with the lanes and clock
+ * mode of the device tree is printed for comparison, the load is the
+ * hs_lane_load of tc358746_get_metrics().
+ *
+ * usage: calc lanes [max_lanes] [rate|power]
+ */
+static int choose_lanes(int argc, char *argv[])
+{
+	int max_lanes = argc > 0 ? strtol(argv[0], NULL, 0) : 4;
+	enum tc358746_lane_policy policy = TC358746_LANES_MIN_RATE;
+	bool all_ok = true;
+	u32 i;
+
+	if (argc > 1 && !strcmp(argv[1], "power")) {
+		policy = TC358746_LANES_MIN_POWER;
+	} else if (max_lanes < 1 || (argc > 1 && strcmp(argv[1], "rate"))) {
+		fprintf(stderr, "usage: calc lanes [max_lanes] [rate|power]\n");
+		return EXIT_FAILURE;
+	}
+
+	fprintf(stdout, "%-10s %-6s %-11s %10s %7s   %-11s %10s %7s\n",
+		"mode", "format", "dt", "lane[bps]", "load[%]", "chosen",
+		"lane[bps]", "load[%]");
+	for (i = 0; i < ARRAY_SIZE(inputs); i++) {
+		struct tc358746_input input = inputs[i];
+		struct tc358746_metrics metrics;
+		struct tc358746_plan plan;
+		struct tc358746 param;
+		char mode[16], lanes[16];
+
+		snprintf(mode, sizeof(mode), "%ux%u", input.width, input.height);
+		snprintf(lanes, sizeof(lanes), "%d %s", input.num_lanes,
+			 input.discontinuous_clk ? "disc" : "cont");
+		fprintf(stdout, "%-10s %-6s %-11s ", mode,
+			calc_format_name(input.mbus_fmt), lanes);
+
+		if (tc358746_find_link_freq(&param, &input,
+					    LINK_FREQ_RESOLUTION,
+					    &input.link_frequency) < 0 ||
+		    tc358746_get_metrics(&param, &input, &metrics) < 0)
+			fprintf(stdout, "%10s %7s   ", "-", "-");
+		else
+			fprintf(stdout, "%10u %3u.%02u   ",
+				param.csi.speed_per_lane,
+				metrics.hs_lane_load / 100,
+				metrics.hs_lane_load % 100);
+
+		if (tc358746_find_lanes(&inputs[i], max_lanes,
+					LINK_FREQ_RESOLUTION, policy,
+					&plan) < 0 ||
+		    tc358746_get_metrics(&plan.param, &plan.input,
+					 &metrics) < 0) {
+			fprintf(stdout, "%-11s\n", "-");
+			all_ok = false;
+			continue;
+		}
+
+		snprintf(lanes, sizeof(lanes), "%d %s", plan.input.num_lanes,
+			 plan.input.discontinuous_clk ? "disc" : "cont");
+		fprintf(stdout, "%-11s %10u %3u.%02u\n", lanes,
+			plan.param.csi.speed_per_lane,
+			metrics.hs_lane_load / 100, metrics.hs_lane_load % 100);
+	}
+
+	return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static const char *reg_name(u8 regmap, u16 addr)
+{
+	static const struct {
+		u8 regmap;
+		u16 addr;
+		const char *name;
+	} regs[] = {
+		{ TC358746_REGMAP_CTL, SYSCTL, "SYSCTL" },
+		{ TC358746_REGMAP_CTL, CONFCTL, "CONFCTL" },
+		{ TC358746_REGMAP_CTL, FIFOCTL, "FIFOCTL" },
+		{ TC358746_REGMAP_CTL, DATAFMT, "DATAFMT" },
+		{ TC358746_REGMAP_CTL, PLLCTL0, "PLLCTL0" },
+		{ TC358746_REGMAP_CTL, PLLCTL1, "PLLCTL1" },
+		{ TC358746_REGMAP_CTL, WORDCNT, "WORDCNT" },
+		{ TC358746_REGMAP_TX, CLW_CNTRL, "CLW_CNTRL" },
+		{ TC358746_REGMAP_TX, D0W_CNTRL, "D0W_CNTRL" },
+		{ TC358746_REGMAP_TX, D1W_CNTRL, "D1W_CNTRL" },
+		{ TC358746_REGMAP_TX, D2W_CNTRL, "D2W_CNTRL" },
+		{ TC358746_REGMAP_TX, D3W_CNTRL, "D3W_CNTRL" },
+		{ TC358746_REGMAP_TX, STARTCNTRL, "STARTCNTRL" },
+		{ TC358746_REGMAP_TX, LINEINITCNT, "LINEINITCNT" },
+		{ TC358746_REGMAP_TX, LPTXTIMECNT, "LPTXTIMECNT" },
+		{ TC358746_REGMAP_TX, TCLK_HEADERCNT, "TCLK_HEADERCNT" },
+		{ TC358746_REGMAP_TX, TCLK_TRAILCNT, "TCLK_TRAILCNT" },
+		{ TC358746_REGMAP_TX, THS_HEADERCNT, "THS_HEADERCNT" },
+		{ TC358746_REGMAP_TX, TWAKEUP, "TWAKEUP" },
+		{ TC358746_REGMAP_TX, TCLK_POSTCNT, "TCLK_POSTCNT" },
+		{ TC358746_REGMAP_TX, THS_TRAILCNT, "THS_TRAILCNT" },
+		{ TC358746_REGMAP_TX, HSTXVREGCNT, "HSTXVREGCNT" },
+		{ TC358746_REGMAP_TX, HSTXVREGEN, "HSTXVREGEN" },
+		{ TC358746_REGMAP_TX, TXOPTIONCNTRL, "TXOPTIONCNTRL" },
+		{ TC358746_REGMAP_TX, CSI_CONFW, "CSI_CONFW" },
+		{ TC358746_REGMAP_TX, CSI_START, "CSI_START" },
+	};
+
+	for (u32 i = 0; i < ARRAY_SIZE(regs); i++)
+		if (regs[i].regmap == regmap && regs[i].addr == addr)
+			return regs[i].name;
+
+	return "?";
+}
+
+/* I2C clock of the bridge */
+#define I2C_BUS_HZ	400000
+
+/*
+ * Bus time of one write transaction of @num registers in us: start, device
+ * address, 16 bit register address, the values, stop. 9 clocks a byte.
+ */
+static u32 i2c_write_us(u8 regmap, u32 num)
+{
+	u32 bytes = 1 + 2 + num * (regmap == TC358746_REGMAP_TX ? 4 : 2);
+
+	return ((bytes * 9 + 2) * 1000000ULL + I2C_BUS_HZ - 1) / I2C_BUS_HZ;
+}
+
+/* the writes of a program with its bus time */
+static void print_writes(const struct tc358746_program *prog)
+{
+	u32 burst = 0, bursts = 0, burst_us = 0, single_us = 0, delay_us = 0;
+
+	for (u32 j = 0; j < prog->num; j++) {
+		const struct tc358746_reg_write *w = prog->writes + j;
+		bool cont = burst > 0;
+
+		if (!cont) {
+			burst = tc358746_program_burst(prog, j);
+			burst_us += i2c_write_us(w->regmap, burst);
+			bursts++;
+		}
+		burst--;
+		single_us += i2c_write_us(w->regmap, 1);
+		delay_us += w->delay_us;
+
+		fprintf(stdout, "\t%c%s 0x%04x %-14s 0x%08x",
+			cont ? '+' : ' ',
+			w->regmap == TC358746_REGMAP_TX ? "tx " : "ctl",
+			w->addr, reg_name(w->regmap, w->addr), w->val);
+		if (w->mask)
+			fprintf(stdout, " mask 0x%08x", w->mask);
+		if (w->delay_us)
+			fprintf(stdout, " delay %u us", w->delay_us);
+		fprintf(stdout, "\n");
+	}
+
+	fprintf(stdout,
+		"\t%u transactions, %u us on the bus (%u transactions, %u us without bursts), %u us delays\n",
+		bursts, burst_us, prog->num, single_us, delay_us);
+}
+
+/* the program of input @i at its link frequency */
+static int input_program(u32 i, struct tc358746_program *prog)
+{
+	struct tc358746 param;
+
+	if (tc358746_calculate(&param, inputs + i) < 0 ||
+	    tc358746_program(&param, inputs + i, prog) < 0)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Print the register program of every input at its link frequency, or at
+ * the one given in Hz, as the driver writes it on stream start. Writes
+ * continuing a burst are marked with '+'. The bus time counts the masked
+ * writes as plain writes, as with the register cache.
+ *
+ * usage: calc program [link_frequency]
+ */
+static int print_program(int argc, char *argv[])
+{
+	bool all_ok = true;
+	u32 i;
+
+	for (i = 0; i < ARRAY_SIZE(inputs); i++) {
+		struct tc358746_input input = inputs[i];
+		struct tc358746_program prog;
+		struct tc358746 param;
+
+		if (argc > 0)
+			input.link_frequency = strtoull(argv[0], NULL, 0);
+
+		fprintf(stdout, "%ux%u %s at %lu Hz:",
+			input.width, input.height,
+			mbus_fmt_to_str(input.mbus_fmt), input.link_frequency);
+
+		if (tc358746_calculate(&param, &input) < 0 ||
+		    tc358746_program(&param, &input, &prog) < 0) {
+			fprintf(stdout, " infeasible\n");
+			all_ok = false;
+			continue;
+		}
+
+		fprintf(stdout, " %u writes\n", prog.num);
+		print_writes(&prog);
+	}
+
+	return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Print the writes of a mode switch from input @from to input @to, both at
+ * their link frequency, as the driver does it with the register shadow. Every
+ * pair of inputs if none is given.
+ *
+ * usage: calc switch [from] [to]
+ */
+static int print_switch(int argc, char *argv[])
+{
+	struct tc358746_program shadow, prog, delta;
+	u32 from, to, first = 0, last = ARRAY_SIZE(inputs) - 1;
+
+	if (argc > 1) {
+		first = strtoul(argv[0], NULL, 0);
+		last = strtoul(argv[1], NULL, 0);
+		if (first >= ARRAY_SIZE(inputs) || last >= ARRAY_SIZE(inputs)) {
+			fprintf(stderr, "usage: calc switch [from] [to]\n");
+			return EXIT_FAILURE;
+		}
+	}
+
+	for (from = first; from <= (argc > 1 ? first : last); from++) {
+		for (to = argc > 1 ? last : first; to <= last; to++) {
+			if (argc <= 1 && from == to)
+				continue;
+
+			fprintf(stdout, "%u %ux%u -> %u %ux%u:", from,
+				inputs[from].width, inputs[from].height, to,
+				inputs[to].width, inputs[to].height);
+
+			if (input_program(from, &shadow) < 0 ||
+			    input_program(to, &prog) < 0) {
+				fprintf(stdout, " infeasible\n");
+				continue;
+			}
+
+			fprintf(stdout, " %u of %u writes skipped\n",
+				tc358746_program_delta(&shadow, &prog, &delta),
+				prog.num);
+			if (argc > 1)
+				print_writes(&delta);
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+/*
+ * Compare the legacy hs->lp->hs model with the exact one plus a safety
+ * margin in percent (default 0), with the clock mode of the inputs or with
+ * both.
+ *
+ * usage: calc hslphs [margin] [both]
+ */
+static int compare_hs_lp_hs(int argc, char *argv[])
+{
+	static const enum tc358746_hs_lp_hs_model models[] = {
+		TC358746_HS_LP_HS_LEGACY,
+		TC358746_HS_LP_HS_EXACT,
+	};
+	unsigned int margin = argc > 0 ? strtoul(argv[0], NULL, 0) : 0;
+	bool both = argc > 1 && !strcmp(argv[1], "both");
+	u32 i, j, k;
+
+	fprintf(stdout, "%-10s %-6s %-5s %-6s %10s %6s %11s %9s\n",
+		"mode", "format", "clock", "model", "hslphs[ns]", "fifo",
+		"lowest[Hz]", "max[fps]");
+
+	for (i = 0; i < ARRAY_SIZE(inputs); i++) {
+		for (k = 0; k < (both ? 2 : 1); k++) {
+			for (j = 0; j < ARRAY_SIZE(models); j++) {
+				struct tc358746_input input = inputs[i];
+				struct tc358746_frame frame;
+				struct tc358746 param;
+				u64 link_freq;
+				char mode[16];
+
+				if (both)
+					input.discontinuous_clk = k;
+				input.hs_lp_hs_model = models[j];
+				input.hs_lp_hs_margin = margin;
+
+				snprintf(mode, sizeof(mode), "%ux%u",
+					 input.width, input.height);
+				fprintf(stdout, "%-10s %-6s %-5s %-6s ", mode,
+					calc_format_name(input.mbus_fmt),
+					input.discontinuous_clk ? "disc" : "cont",
+					models[j] == TC358746_HS_LP_HS_EXACT ?
+					"exact" : "legacy");
+
+				if (tc358746_calculate(&param, &input) < 0 ||
+				    tc358746_frame_timing(&param, &input,
+							  &frame) < 0) {
+					fprintf(stdout, "%10s %6s ", "-", "-");
+					frame.max_framerate = 0;
+				} else {
+					fprintf(stdout, "%10lu %6u ",
+						param.csi.csi_hs_lp_hs_ps / 1000,
+						param.vb_fifo);
+				}
+
+				input.framerate = 0;
+				if (tc358746_find_link_freq(&param, &input,
+							    LINK_FREQ_RESOLUTION,
+							    &link_freq) < 0)
+					link_freq = 0;
+
+				fprintf(stdout, "%11lu %5lu.%03lu\n", link_freq,
+					fps_args(frame.max_framerate));
+			}
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+static int run_try_inputs(int argc __maybe_unused,
+			  char *argv[] __maybe_unused)
+{
+	return try_inputs();
+}
+
+static int run_find_lowest_link_freq(int argc __maybe_unused,
+				     char *argv[] __maybe_unused)
 {
-	/* return try_inputs(); */
 	return find_lowest_link_freq();
 }
+
+static const struct {
+	const char *name;
+	int (*run)(int argc, char *argv[]);
+	const char *help;
+} commands[] = {
+	{ "lowest", run_find_lowest_link_freq,
+	  "find the lowest link frequency of every input (default)" },
+	{ "inputs", run_try_inputs,
+	  "calculate the parameters of every input as is" },
+	{ "frames", print_frames,
+	  "[framerate]: frame timing and lowest link frequency per frame rate" },
+	{ "hblank", print_min_hblank,
+	  "[pclk]: smallest hblank and highest frame rate of every input" },
+	{ "plan", plan_mode,
+	  "<width> <height> <fps> <format> <lanes> [vblank] [count]: plan a mode" },
+	{ "lanes", choose_lanes,
+	  "[max_lanes] [rate|power]: choose lanes and clock mode of every input" },
+	{ "program", print_program,
+	  "[link frequency]: register program of every input" },
+	{ "switch", print_switch,
+	  "[from] [to]: writes of a mode switch between inputs" },
+	{ "hslphs", compare_hs_lp_hs,
+	  "[margin] [both]: compare the legacy and exact hs->lp->hs models" },
+	{ "header", write_modes_header,
+	  "<output> <link frequency>...: write the driver parameter table" },
+	{ "verify-fifo", verify_fifo,
+	  "[iterations] [seed]: compare fifo sizing against the reference loop" },
+	{ "verify-ctx", verify_ctx,
+	  "[iterations] [seed]: compare the staged calculation against calculate" },
+	{ "verify-batch", verify_batch,
+	  "[count] [seed]: compare the batch calculation against calculate" },
+	{ "verify-link", verify_link,
+	  "[iterations] [seed] [resolution]: compare the link frequency search against a scan" },
+	{ "verify-program", verify_program,
+	  "[iterations] [seed]: run register programs through the driver on logging regmaps" },
+	{ "explore", explore,
+	  "[options]: parallel design space sweep, see explore --help" },
+	{ "simulate", simulate,
+	  "[options]: simulate the fifo of a mode, see simulate --help" },
+};
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [command] [args]\n", prog);
+	for (u32 i = 0; i < ARRAY_SIZE(commands); i++)
+		fprintf(stderr, "  %-12s %s\n", commands[i].name, commands[i].help);
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc < 2)
+		return find_lowest_link_freq();
+
+	for (u32 i = 0; i < ARRAY_SIZE(commands); i++)
+		if (!strcmp(argv[1], commands[i].name))
+			return commands[i].run(argc - 2, argv + 2);
+
+	usage(argv[0]);
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,98 @@
+#include <errno.h>
+#include <string.h>
+#include <linux/regmap.h>
+#include "regmap_mock.h"
+
+/* registers are val_bytes wide, at a stride of val_bytes */
+void regmap_mock_init(struct regmap *map, unsigned int id,
+		      unsigned int val_bytes, struct regmap_mock_log *log)
+{
+	memset(map, 0, sizeof(*map));
+	map->id = id;
+	map->val_bytes = val_bytes;
+	map->log = log;
+}
+
+static int regmap_mock_check(struct regmap *map, unsigned int reg,
+			     size_t count)
+{
+	if (reg % map->val_bytes ||
+	    reg + count * map->val_bytes > REGMAP_MOCK_REGS)
+		return -EINVAL;
+	if (map->log->num + count > REGMAP_MOCK_WRITES)
+		return -ENOSPC;
+
+	return 0;
+}
+
+static void regmap_mock_log(struct regmap *map, unsigned int reg,
+			    unsigned int val)
+{
+	struct regmap_mock_write *w = map->log->writes + map->log->num++;
+
+	map->regs[reg] = val;
+	w->id = map->id;
+	w->addr = reg;
+	w->val = val;
+}
+
+int regmap_read(struct regmap *map, unsigned int reg, unsigned int *val)
+{
+	if (regmap_mock_check(map, reg, 0))
+		return -EINVAL;
+
+	*val = map->regs[reg];
+	return 0;
+}
+
+int regmap_write(struct regmap *map, unsigned int reg, unsigned int val)
+{
+	int err = regmap_mock_check(map, reg, 1);
+
+	if (err)
+		return err;
+
+	regmap_mock_log(map, reg, val);
+	map->log->transactions++;
+	return 0;
+}
+
+/* the old value comes from the cache, one transaction writes it back */
+int regmap_update_bits(struct regmap *map, unsigned int reg,
+		       unsigned int mask, unsigned int val)
+{
+	int err = regmap_mock_check(map, reg, 1);
+
+	if (err)
+		return err;
+
+	regmap_mock_log(map, reg, (map->regs[reg] & ~mask) | (val & mask));
+	map->log->transactions++;
+	return 0;
+}
+
+int regmap_bulk_write(struct regmap *map, unsigned int reg, const void *val,
+		      size_t val_count)
+{
+	int err = regmap_mock_check(map, reg, val_count);
+	size_t i;
+
+	if (err)
+		return err;
+
+	for (i = 0; i < val_count; i++)
+		regmap_mock_log(map, reg + i * map->val_bytes,
+				map->val_bytes == 4 ? ((const u32 *)val)[i] :
+						      ((const u16 *)val)[i]);
+	map->log->transactions++;
+	return 0;
+}
+
+int regcache_drop_region(struct regmap *map, unsigned int min,
+			 unsigned int max)
+{
+	(void)map;
+	(void)min;
+	(void)max;
+	return 0;
+}
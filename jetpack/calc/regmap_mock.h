@@ -0,0 +1,38 @@
+#ifndef REGMAP_MOCK_H
+#define REGMAP_MOCK_H
+
+#include <linux/types.h>
+
+#define REGMAP_MOCK_REGS	0x800
+#define REGMAP_MOCK_WRITES	64
+
+/* one register written, a burst logs every register of it */
+struct regmap_mock_write {
+	unsigned int id;
+	u16 addr;
+	u32 val;
+};
+
+/* the writes of every regmap sharing the log, in order */
+struct regmap_mock_log {
+	unsigned int transactions;
+	unsigned int num;
+	struct regmap_mock_write writes[REGMAP_MOCK_WRITES];
+};
+
+/*
+ * Register space of the host tools behind the regmap calls of the driver.
+ * Reads come from the register values, as from the register cache, only
+ * the write transactions on the bus are counted.
+ */
+struct regmap {
+	unsigned int id;
+	unsigned int val_bytes;
+	u32 regs[REGMAP_MOCK_REGS];
+	struct regmap_mock_log *log;
+};
+
+void regmap_mock_init(struct regmap *map, unsigned int id,
+		      unsigned int val_bytes, struct regmap_mock_log *log);
+
+#endif
@@ -0,0 +1,549 @@
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "calc.h"
+#include "tc358746_calculation.h"
+#include <linux/math.h>
+#include <linux/minmax.h>
+#include <uapi/linux/media-bus-format.h>
+
+/*
+ * Discrete-event simulation of the VB fifo of one configuration.
+ *
+ * The parallel port writes bpp bits per pixel into the fifo on the last
+ * pclk of every pixel of the active lines, hblank and vblank write nothing.
+ * Once vb_fifo * 32 / bus_width pclks of a line are in (or the whole line,
+ * if it is shorter), the csi tx starts the line 4 hs byte clocks later
+ * (see tc358746_get_c_hactive()) or as soon as the hs->lp->hs transition of
+ * the line before is over, whichever comes last. Then it drains num_lanes
+ * bytes per hs byte clock until the line is out, and the transition of
+ * csi.csi_hs_lp_hs_ps follows. Frame start and end packets go into the
+ * vblank and are not simulated.
+ *
+ * Both clocks run at their real frequency, pclk and the lane rate the pll
+ * reaches. Times are in fs, edge k of a clock is at k * 10^15 / Hz rounded
+ * down, so the phase between the clocks drifts over the lines like on the
+ * hardware. Clock edges without anything to do (blanking, idle csi) are
+ * skipped.
+ *
+ * Per line the simulation records the peak fifo occupancy, the minimum
+ * while the line is sent and still coming in (below zero the csi tx would
+ * send data it doesn't have yet: underflow) and how late the line started
+ * because the transition of the line before wasn't over.
+ */
+
+#define SIM_FS_PER_S		1000000000000000ULL
+#define SIM_NEVER		~0ULL
+/* fifo depth in 32 bit words, the largest vb_fifo the driver programs */
+#define SIM_FIFO_DEPTH		512
+
+/*
+ * Edge k of a clock is at t = floor(k * 10^15 / hz) fs. With
+ * 10^15 = q * hz + r stepping one edge adds q and carries the fraction
+ * acc / hz = k * r / hz - floor(k * r / hz).
+ */
+struct sim_clock {
+	u64 hz;
+	u64 q, r;
+	u64 k;		/* next edge */
+	u64 t;		/* fs */
+	u64 acc;
+};
+
+struct sim_line {
+	u64 start_fs;		/* first pclk of the parallel line */
+	u64 ready_fs;		/* when the csi tx should start the line */
+	u64 hs_start_fs;
+	u64 hs_end_fs;
+	s64 peak_bits;
+	s64 min_bits;		/* while the line is sent and comes in */
+};
+
+struct sim {
+	struct tc358746_input input;
+	struct tc358746 param;
+	unsigned int frames;
+	unsigned int depth;	/* 32 bit words */
+	bool lines_csv;
+
+	/* results */
+	struct sim_line *lines;
+	unsigned int lines_num;	/* frames * height */
+	unsigned int underflows, overflows, late;
+};
+
+static void sim_clock_set(struct sim_clock *c, u64 k)
+{
+	c->k = k;
+	c->t = (unsigned __int128)k * SIM_FS_PER_S / c->hz;
+	c->acc = (unsigned __int128)k * c->r % c->hz;
+}
+
+static void sim_clock_init(struct sim_clock *c, u64 hz)
+{
+	c->hz = hz;
+	c->q = SIM_FS_PER_S / hz;
+	c->r = SIM_FS_PER_S % hz;
+	sim_clock_set(c, 0);
+}
+
+static void sim_clock_step(struct sim_clock *c)
+{
+	c->k++;
+	c->t += c->q;
+	c->acc += c->r;
+	if (c->acc >= c->hz) {
+		c->acc -= c->hz;
+		c->t++;
+	}
+}
+
+/* move to the first edge at or after t_fs */
+static void sim_clock_seek(struct sim_clock *c, u64 t_fs)
+{
+	sim_clock_set(c, ((unsigned __int128)t_fs * c->hz + SIM_FS_PER_S - 1) /
+			 SIM_FS_PER_S);
+}
+
+static int sim_run(struct sim *s)
+{
+	const struct tc358746_mbus_fmt *format = s->param.format;
+	const struct tc358746_input *input = &s->input;
+	u64 active = (u64)format->ppp * input->width;
+	u64 line_pclks = active + input->hblank;
+	u64 frame_pclks = line_pclks * (input->height + input->vblank);
+	u64 trigger = min_t(u64, s->param.vb_fifo * 32 / format->bus_width,
+			    active - 1);
+	u64 line_bits = (u64)format->bpp * input->width;
+	u64 lane_bits = 8 * s->param.csi.lane_num;
+	u64 hs_lp_hs_fs = s->param.csi.csi_hs_lp_hs_ps * 1000;
+	u64 hs_hz = s->param.csi.speed_per_lane >> 3;
+	u64 start_delay_fs, ready_fs = 0, remaining = 0, hs_period_fs;
+	struct sim_clock pclk, hs;
+	unsigned int frame = 0, line = 0;	/* of the next pclk */
+	unsigned int rx = 0, tx = 0;	/* next line to trigger, to send */
+	unsigned int arrived = 0;	/* lines completely in */
+	unsigned int i;
+	bool hs_busy = false, hs_wait = false;
+	u64 pos = 0;
+	s64 occ = 0;
+
+	if (!active || !frame_pclks || !hs_hz || !input->pclk)
+		return -1;
+
+	sim_clock_init(&pclk, input->pclk);
+	sim_clock_init(&hs, hs_hz);
+	hs_period_fs = hs.q;
+	start_delay_fs = 4 * hs_period_fs;
+
+	s->lines_num = s->frames * input->height;
+	s->lines = calloc(s->lines_num, sizeof(*s->lines));
+	if (!s->lines) {
+		perror("calloc");
+		return -1;
+	}
+	s->underflows = s->overflows = s->late = 0;
+
+	for (;;) {
+		u64 tp = frame < s->frames ? pclk.t : SIM_NEVER;
+		u64 th = hs_busy || hs_wait ? hs.t : SIM_NEVER;
+		struct sim_line *l;
+
+		if (tp == SIM_NEVER && th == SIM_NEVER)
+			break;
+
+		if (tp <= th) {
+			l = s->lines + frame * input->height + line;
+			if (pos == 0) {
+				l->start_fs = tp;
+				l->peak_bits = occ;
+			}
+
+			if (pos == trigger) {
+				l->ready_fs = tp + start_delay_fs;
+				rx++;
+				if (!hs_busy && !hs_wait) {
+					sim_clock_seek(&hs, max(l->ready_fs,
+								ready_fs));
+					hs_wait = true;
+				}
+			}
+
+			if ((pos + 1) % format->ppp == 0) {
+				occ += format->bpp;
+				if (occ > l->peak_bits)
+					l->peak_bits = occ;
+			}
+
+			if (++pos < active) {
+				sim_clock_step(&pclk);
+				continue;
+			}
+
+			/* skip the hblank and the vblank */
+			arrived++;
+			pos = 0;
+			if (++line == input->height) {
+				line = 0;
+				frame++;
+			}
+			sim_clock_set(&pclk, frame * frame_pclks +
+					     line * line_pclks);
+			continue;
+		}
+
+		/* hs byte clock */
+		l = s->lines + tx;
+		if (hs_wait) {
+			hs_wait = false;
+			hs_busy = true;
+			remaining = line_bits;
+			l->hs_start_fs = th;
+			l->min_bits = occ;
+			if (th > l->ready_fs + hs_period_fs)
+				s->late++;
+		}
+
+		occ -= min_t(u64, remaining, lane_bits);
+		remaining -= min_t(u64, remaining, lane_bits);
+		if (tx >= arrived && occ < l->min_bits)
+			l->min_bits = occ;
+
+		if (remaining) {
+			sim_clock_step(&hs);
+			continue;
+		}
+
+		l->hs_end_fs = th;
+		ready_fs = th + hs_lp_hs_fs;
+		hs_busy = false;
+		if (++tx < rx) {
+			sim_clock_seek(&hs, max(s->lines[tx].ready_fs, ready_fs));
+			hs_wait = true;
+		}
+	}
+
+	/*
+	 * The data an underflowed line was missing arrives later and evens
+	 * the occupancy out, it doesn't spill into the next line.
+	 */
+	for (i = 0; i < s->lines_num; i++) {
+		s->underflows += s->lines[i].min_bits < 0;
+		s->overflows += s->lines[i].peak_bits > (s64)s->depth * 32;
+	}
+
+	return 0;
+}
+
+static void sim_print_lines(const struct sim *s)
+{
+	unsigned int i;
+
+	fprintf(stdout, "frame,line,peak_bits,min_bits,hs_start_ps,hs_end_ps,"
+		"late_ps\n");
+	for (i = 0; i < s->lines_num; i++) {
+		const struct sim_line *l = s->lines + i;
+		s64 late = l->hs_start_fs - l->ready_fs;
+
+		fprintf(stdout, "%u,%u,%lld,%lld,%llu,%llu,%lld\n",
+			i / s->input.height, i % s->input.height,
+			(long long)l->peak_bits, (long long)l->min_bits,
+			(unsigned long long)(l->hs_start_fs - l->start_fs) /
+				1000,
+			(unsigned long long)(l->hs_end_fs - l->start_fs) / 1000,
+			(long long)(late > 0 ? late : 0) / 1000);
+	}
+}
+
+static void sim_print_frames(const struct sim *s)
+{
+	unsigned int f, i;
+
+	for (f = 0; f < s->frames; f++) {
+		const struct sim_line *lines = s->lines + f * s->input.height;
+		unsigned int peak = 0, low = 0;
+
+		for (i = 1; i < s->input.height; i++) {
+			if (lines[i].peak_bits > lines[peak].peak_bits)
+				peak = i;
+			if (lines[i].min_bits < lines[low].min_bits)
+				low = i;
+		}
+
+		fprintf(stdout,
+			"frame %u: peak %lld bits (%lld words) in line %u, min %lld bits in line %u\n",
+			f, (long long)lines[peak].peak_bits,
+			(long long)DIV_ROUND_UP(lines[peak].peak_bits, 32),
+			peak, (long long)lines[low].min_bits, low);
+	}
+}
+
+static bool sim_clean(const struct sim *s)
+{
+	return !s->underflows && !s->overflows && !s->late;
+}
+
+static int sim_try(struct sim *s, unsigned int fifo, bool *underflow,
+		   bool *clean)
+{
+	s->param.vb_fifo = fifo;
+	if (sim_run(s) < 0)
+		return -1;
+	free(s->lines);
+
+	*underflow = s->underflows;
+	*clean = sim_clean(s);
+	return 0;
+}
+
+/*
+ * The fifo sizes without underflow, overflow or late lines. A larger fifo
+ * starts every line later, so the fifo holds more data: underflows only go
+ * away and overflows only come. The late lines don't depend on the fifo
+ * size as long as the trigger is within the line. Thus the sizes that work
+ * are one range, found by bisection.
+ */
+static int sim_sweep(struct sim *s)
+{
+	u16 calculated = s->param.vb_fifo;
+	unsigned int lo = 1, hi = SIM_FIFO_DEPTH - 1, mid, first;
+	bool underflow, clean;
+
+	/* the smallest size without underflow */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (sim_try(s, mid, &underflow, &clean) < 0)
+			return -1;
+		if (underflow)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (sim_try(s, lo, &underflow, &clean) < 0)
+		return -1;
+	s->param.vb_fifo = calculated;
+	if (!clean) {
+		fprintf(stdout, "clean fifo sizes: none (calculated %u)\n",
+			calculated);
+		return 0;
+	}
+
+	/* the largest clean size */
+	first = lo;
+	hi = SIM_FIFO_DEPTH - 1;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (sim_try(s, mid, &underflow, &clean) < 0)
+			return -1;
+		if (clean)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	s->param.vb_fifo = calculated;
+	fprintf(stdout, "clean fifo sizes: %u-%u (calculated %u)\n", first, lo,
+		calculated);
+	return 0;
+}
+
+static void sim_usage(void)
+{
+	fprintf(stderr,
+		"usage: calc simulate [options]\n"
+		"  -f, --format NAME      see explore --help (rgb888)\n"
+		"  -w, --width N          active width (640)\n"
+		"  -H, --height N         active lines (480)\n"
+		"  -b, --hblank N         pixels (54)\n"
+		"  -v, --vblank N         lines (0)\n"
+		"  -p, --pclk HZ          (20000000)\n"
+		"  -L, --link HZ          link frequency (249000000)\n"
+		"  -l, --lanes N          (2)\n"
+		"  -R, --refclk HZ        (24000000)\n"
+		"  -c, --clock N          0 continuous, 1 discontinuous (0)\n"
+		"  -m, --model NAME       hs->lp->hs model, legacy or exact (legacy)\n"
+		"  -M, --margin N         %% added to the exact model (0)\n"
+		"  -F, --fifo N           simulate this fifo size instead\n"
+		"  -d, --depth N          fifo depth in 32 bit words (%u)\n"
+		"  -n, --frames N         (1)\n"
+		"  -s, --sweep            find the fifo sizes that work\n"
+		"  -V, --lines            per line CSV\n",
+		SIM_FIFO_DEPTH);
+}
+
+/*
+ * usage: calc simulate [options], see sim_usage()
+ */
+int simulate(int argc, char *argv[])
+{
+	static const struct option options[] = {
+		{ "format", required_argument, NULL, 'f' },
+		{ "width", required_argument, NULL, 'w' },
+		{ "height", required_argument, NULL, 'H' },
+		{ "hblank", required_argument, NULL, 'b' },
+		{ "vblank", required_argument, NULL, 'v' },
+		{ "pclk", required_argument, NULL, 'p' },
+		{ "link", required_argument, NULL, 'L' },
+		{ "lanes", required_argument, NULL, 'l' },
+		{ "refclk", required_argument, NULL, 'R' },
+		{ "clock", required_argument, NULL, 'c' },
+		{ "model", required_argument, NULL, 'm' },
+		{ "margin", required_argument, NULL, 'M' },
+		{ "fifo", required_argument, NULL, 'F' },
+		{ "depth", required_argument, NULL, 'd' },
+		{ "frames", required_argument, NULL, 'n' },
+		{ "sweep", no_argument, NULL, 's' },
+		{ "lines", no_argument, NULL, 'V' },
+		{ "help", no_argument, NULL, 'h' },
+		{ },
+	};
+	struct sim s = {
+		.input = {
+			.mbus_fmt = MEDIA_BUS_FMT_RGB888_1X24,
+			.refclk = 24000000,
+			.link_frequency = 249000000,
+			.num_lanes = 2,
+			.pclk = 20000000,
+			.width = 640,
+			.hblank = 54,
+			.height = 480,
+		},
+		.frames = 1,
+		.depth = SIM_FIFO_DEPTH,
+	};
+	struct tc358746_metrics m;
+	struct tc358746_diag diag;
+	bool sweep = false, clean;
+	int opt, fifo = 0;
+
+	/* argv[0] is the first argument, getopt skips it */
+	argc++;
+	argv--;
+	optind = 1;
+
+	while ((opt = getopt_long(argc, argv, "f:w:H:b:v:p:L:l:R:c:m:M:F:d:n:sVh",
+				  options, NULL)) != -1) {
+		int err = 0;
+
+		switch (opt) {
+		case 'f':
+			s.input.mbus_fmt = calc_format_code(optarg);
+			err = s.input.mbus_fmt ? 0 : -1;
+			break;
+		case 'w':
+			s.input.width = strtoul(optarg, NULL, 0);
+			break;
+		case 'H':
+			s.input.height = strtoul(optarg, NULL, 0);
+			break;
+		case 'b':
+			s.input.hblank = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			s.input.vblank = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			s.input.pclk = strtoul(optarg, NULL, 0);
+			break;
+		case 'L':
+			s.input.link_frequency = strtoull(optarg, NULL, 0);
+			break;
+		case 'l':
+			s.input.num_lanes = strtol(optarg, NULL, 0);
+			break;
+		case 'R':
+			s.input.refclk = strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			s.input.discontinuous_clk = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			if (!strcmp(optarg, "legacy"))
+				s.input.hs_lp_hs_model = TC358746_HS_LP_HS_LEGACY;
+			else if (!strcmp(optarg, "exact"))
+				s.input.hs_lp_hs_model = TC358746_HS_LP_HS_EXACT;
+			else
+				err = -1;
+			break;
+		case 'M':
+			s.input.hs_lp_hs_margin = strtoul(optarg, NULL, 0);
+			break;
+		case 'F':
+			fifo = strtol(optarg, NULL, 0);
+			if (fifo < 1 || fifo >= SIM_FIFO_DEPTH)
+				err = -1;
+			break;
+		case 'd':
+			s.depth = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			s.frames = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			sweep = true;
+			break;
+		case 'V':
+			s.lines_csv = true;
+			break;
+		default:
+			err = -1;
+			break;
+		}
+
+		if (err) {
+			sim_usage();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!s.input.height || !s.frames) {
+		sim_usage();
+		return EXIT_FAILURE;
+	}
+
+	if (tc358746_calculate_diag(&s.param, &s.input, &diag)) {
+		fprintf(stderr, "no configuration: %s (%llu, bound %llu)\n",
+			tc358746_reason_str(diag.reason),
+			(unsigned long long)diag.value,
+			(unsigned long long)diag.bound);
+		/* still simulate a given fifo size, if the rest is there */
+		if (!fifo || (diag.reason != TC358746_REASON_FIFO_DEPTH &&
+			      diag.reason != TC358746_REASON_LINE))
+			return EXIT_FAILURE;
+	}
+
+	if (fifo)
+		s.param.vb_fifo = fifo;
+
+	fprintf(stdout,
+		"%s %ux%u hblank %u vblank %u pclk %u, %d lanes at %u bps, vb_fifo %u, hs_lp_hs %llu ps\n",
+		calc_format_name(s.input.mbus_fmt), s.input.width,
+		s.input.height, s.input.hblank, s.input.vblank, s.input.pclk,
+		s.input.num_lanes, s.param.csi.speed_per_lane,
+		s.param.vb_fifo,
+		(unsigned long long)s.param.csi.csi_hs_lp_hs_ps);
+
+	if (!tc358746_get_metrics(&s.param, &s.input, &m))
+		fprintf(stdout,
+			"calculated: hactive slack %lld ps, lp slack %lld ps\n",
+			(long long)m.hactive_slack_ps,
+			(long long)m.lp_slack_ps);
+
+	if (sim_run(&s) < 0)
+		return EXIT_FAILURE;
+
+	if (s.lines_csv)
+		sim_print_lines(&s);
+	sim_print_frames(&s);
+	fprintf(stdout, "simulated: %u underflow, %u overflow, %u late lines\n",
+		s.underflows, s.overflows, s.late);
+	free(s.lines);
+	clean = sim_clean(&s);
+
+	if (sweep && sim_sweep(&s) < 0)
+		return EXIT_FAILURE;
+
+	return clean ? EXIT_SUCCESS : EXIT_FAILURE;
+}
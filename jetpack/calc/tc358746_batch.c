@@ -0,0 +1,291 @@
+/*
+ * Batch calculation for design space sweeps on the host, not for the
+ * driver: the feasibility kernel uses floating point SIMD.
+ *
+ * The kernel rejects the inputs which fail tc358746_calculate() for sure:
+ * out of range lanes, refclk, lane rate or pclk, a fifo too small to delay
+ * the csi line enough, or a line too short for the csi line even at the
+ * highest lane rate. Only the survivors go through the full calculation.
+ *
+ * The kernel must never reject a feasible input. The integer calculation
+ * rounds every duration down to whole fs, so the kernel works with bounds
+ * of the periods rather than the exact values, these are loose enough for
+ * any rounding:
+ *
+ * 10^12 / pclk - 1 <= pclk_period_ps <= 10^12 / (pclk - 1000)
+ *
+ * The PLL reaches at least the requested lane rate and at most 1 Gbps,
+ * which bounds the csi periods the same way. A relative margin of 10^-9
+ * covers the rounding of the doubles.
+ */
+#include <stdint.h>
+#include <string.h>
+#include "tc358746_batch.h"
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define BATCH_BLOCK	256
+#define BATCH_MARGIN	1e-9
+
+#if defined(__AVX__)
+#define BATCH_ISA	"avx"
+#define VW		4
+typedef __m256d vd;
+typedef __m256d vm;
+#define vset(x)		_mm256_set1_pd(x)
+#define vload(p)	_mm256_loadu_pd(p)
+#define vadd(a, b)	_mm256_add_pd(a, b)
+#define vsub(a, b)	_mm256_sub_pd(a, b)
+#define vmul(a, b)	_mm256_mul_pd(a, b)
+#define vdiv(a, b)	_mm256_div_pd(a, b)
+#define vlt(a, b)	_mm256_cmp_pd(a, b, _CMP_LT_OQ)
+#define vle(a, b)	_mm256_cmp_pd(a, b, _CMP_LE_OQ)
+#define vand(a, b)	_mm256_and_pd(a, b)
+#define vor(a, b)	_mm256_or_pd(a, b)
+#define vandnot(a, b)	_mm256_andnot_pd(b, a)	/* a & ~b */
+#define vbits(m)	_mm256_movemask_pd(m)
+#elif defined(__SSE2__)
+#define BATCH_ISA	"sse2"
+#define VW		2
+typedef __m128d vd;
+typedef __m128d vm;
+#define vset(x)		_mm_set1_pd(x)
+#define vload(p)	_mm_loadu_pd(p)
+#define vadd(a, b)	_mm_add_pd(a, b)
+#define vsub(a, b)	_mm_sub_pd(a, b)
+#define vmul(a, b)	_mm_mul_pd(a, b)
+#define vdiv(a, b)	_mm_div_pd(a, b)
+#define vlt(a, b)	_mm_cmplt_pd(a, b)
+#define vle(a, b)	_mm_cmple_pd(a, b)
+#define vand(a, b)	_mm_and_pd(a, b)
+#define vor(a, b)	_mm_or_pd(a, b)
+#define vandnot(a, b)	_mm_andnot_pd(b, a)
+#define vbits(m)	_mm_movemask_pd(m)
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define BATCH_ISA	"neon"
+#define VW		2
+typedef float64x2_t vd;
+typedef uint64x2_t vm;
+#define vset(x)		vdupq_n_f64(x)
+#define vload(p)	vld1q_f64(p)
+#define vadd(a, b)	vaddq_f64(a, b)
+#define vsub(a, b)	vsubq_f64(a, b)
+#define vmul(a, b)	vmulq_f64(a, b)
+#define vdiv(a, b)	vdivq_f64(a, b)
+#define vlt(a, b)	vcltq_f64(a, b)
+#define vle(a, b)	vcleq_f64(a, b)
+#define vand(a, b)	vandq_u64(a, b)
+#define vor(a, b)	vorrq_u64(a, b)
+#define vandnot(a, b)	vbicq_u64(a, b)
+#define vbits(m)	((int)(vgetq_lane_u64(m, 0) & 1) | \
+			 (int)(vgetq_lane_u64(m, 1) & 1) << 1)
+#else
+#define BATCH_ISA	"scalar"
+#define VW		1
+typedef double vd;
+typedef int vm;
+#define vset(x)		((double)(x))
+#define vload(p)	(*(p))
+#define vadd(a, b)	((a) + (b))
+#define vsub(a, b)	((a) - (b))
+#define vmul(a, b)	((a) * (b))
+#define vdiv(a, b)	((a) / (b))
+#define vlt(a, b)	((a) < (b))
+#define vle(a, b)	((a) <= (b))
+#define vand(a, b)	((a) & (b))
+#define vor(a, b)	((a) | (b))
+#define vandnot(a, b)	((a) & !(b))
+#define vbits(m)	(m)
+#endif
+
+/* one block of the batch, converted for the kernel */
+struct batch_block {
+	double valid[BATCH_BLOCK];	/* 1 if format and width are fine */
+	double refclk[BATCH_BLOCK];
+	double bps[BATCH_BLOCK];	/* 2 * link_frequency */
+	double lanes[BATCH_BLOCK];
+	double pclk[BATCH_BLOCK];
+	double width[BATCH_BLOCK];
+	double hblank[BATCH_BLOCK];
+	double bpp[BATCH_BLOCK];
+	double ppp[BATCH_BLOCK];
+	double bus_width[BATCH_BLOCK];
+	u8 pass[BATCH_BLOCK];
+};
+
+static void batch_gather(const struct tc358746_batch *batch,
+			 unsigned int first, unsigned int num,
+			 struct batch_block *b)
+{
+	const struct tc358746_mbus_fmt *format = NULL;
+	u32 code = 0;
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		unsigned int k = first + i;
+
+		if (!format || batch->mbus_fmt[k] != code) {
+			code = batch->mbus_fmt[k];
+			format = tc358746_find_format(code);
+		}
+
+		b->valid[i] = format &&
+			      !((u64)batch->width[k] * format->bpp % 8);
+		b->refclk[i] = batch->refclk[k];
+		b->bps[i] = 2.0 * batch->link_frequency[k];
+		b->lanes[i] = batch->num_lanes[k];
+		b->pclk[i] = batch->pclk[k];
+		b->width[i] = batch->width[k];
+		b->hblank[i] = batch->hblank[k];
+		b->bpp[i] = format ? format->bpp : 1;
+		b->ppp[i] = format ? format->ppp : 1;
+		b->bus_width[i] = format ? format->bus_width : 1;
+
+		/* no format: code 0 has to be looked up again */
+		if (!format)
+			code = 0;
+	}
+
+	/* pad the last vector with inputs the kernel rejects */
+	for (; i % VW; i++)
+		b->valid[i] = 0;
+}
+
+static void batch_kernel(struct batch_block *b, unsigned int num)
+{
+	const vd one = vset(1.0), ps = vset(1e12);
+	unsigned int i, j;
+
+	for (i = 0; i < num; i += VW) {
+		vd lanes = vload(b->lanes + i), refclk = vload(b->refclk + i);
+		vd bps = vload(b->bps + i), pclk = vload(b->pclk + i);
+		vd width = vload(b->width + i), hblank = vload(b->hblank + i);
+		vd bpp = vload(b->bpp + i), ppp = vload(b->ppp + i);
+		vd bus_width = vload(b->bus_width + i);
+		vd bits, active, pp_lo, pp_hi, p_hactive_lo, p_htotal_hi;
+		vd c_data_hi, c_data_lo, hp_hi, c_min_hi, c_min_lo;
+		vm ok, bounded, fifo_fail, line_fail;
+		int mask;
+
+		/* the range checks of the stages before the fifo */
+		ok = vlt(vset(0.5), vload(b->valid + i));
+		ok = vand(ok, vand(vle(one, lanes), vle(lanes, vset(4))));
+		ok = vand(ok, vand(vle(vset(6000000), refclk),
+				   vle(refclk, vset(40000000))));
+		ok = vand(ok, vand(vle(vset(62500000), bps),
+				   vle(bps, vset(1000000000))));
+		ok = vand(ok, vle(vset(1000), pclk));
+
+		/* the period bounds need pclk / 1000 >= 2 */
+		bounded = vle(vset(2000), pclk);
+		pp_lo = vsub(vdiv(ps, pclk), one);
+		pp_hi = vdiv(ps, vsub(pclk, vset(1000)));
+		active = vmul(ppp, width);
+		p_hactive_lo = vmul(pp_lo, active);
+		p_htotal_hi = vmul(pp_hi, vadd(active, hblank));
+		bits = vmul(bpp, width);
+
+		/*
+		 * Even the largest fifo doesn't make the csi line longer than
+		 * the parallel one, at the requested lane rate:
+		 * c_data + 4 * hsclk_period + 511 * 32 * pclk_period / bus_width
+		 *	< p_hactive
+		 */
+		c_data_hi = vdiv(vmul(bits, ps),
+				 vsub(vmul(bps, lanes), vset(1000)));
+		hp_hi = vdiv(ps, vsub(vdiv(bps, vset(8)), vset(1001)));
+		c_min_hi = vadd(vadd(c_data_hi, vmul(vset(4), hp_hi)),
+				vdiv(vmul(vset(511 * 32), pp_hi), bus_width));
+		fifo_fail = vlt(c_min_hi,
+				vmul(p_hactive_lo, vset(1 - BATCH_MARGIN)));
+
+		/*
+		 * Even at 1 Gbps per lane with the smallest fifo the csi line
+		 * is longer than the parallel one, hsclk_period >= 8000 ps:
+		 * c_data + 4 * 8000 + 32 * pclk_period / bus_width >= p_htotal
+		 */
+		c_data_lo = vmul(vsub(vdiv(vset(1000), lanes), one), bits);
+		c_min_lo = vadd(vadd(c_data_lo, vset(4 * 8000)),
+				vsub(vdiv(vmul(vset(32), pp_lo), bus_width),
+				     one));
+		line_fail = vle(vmul(p_htotal_hi, vset(1 + BATCH_MARGIN)),
+				c_min_lo);
+
+		ok = vandnot(ok, vand(bounded, vor(fifo_fail, line_fail)));
+
+		mask = vbits(ok);
+		for (j = 0; j < VW; j++)
+			b->pass[i + j] = mask >> j & 1;
+	}
+}
+
+const char *tc358746_batch_isa(void)
+{
+	return BATCH_ISA;
+}
+
+/*
+ * Calculate the batch->num inputs of @batch. results[i] is set if
+ * feasible[i] is true, the same as tc358746_calculate() would set it.
+ * Returns the number of feasible inputs, @rejected (may be NULL) counts
+ * the ones the feasibility kernel rejected without the full calculation.
+ */
+int tc358746_calculate_batch(const struct tc358746_batch *batch,
+			     struct tc358746 *results, bool *feasible,
+			     unsigned int *rejected)
+{
+	static __thread struct batch_block b;
+	struct tc358746_input input = {
+		.hs_lp_hs_model = batch->hs_lp_hs_model,
+		.hs_lp_hs_margin = batch->hs_lp_hs_margin,
+	};
+	unsigned int first, i, num, found = 0, skipped = 0;
+	struct tc358746_ctx ctx;
+
+	tc358746_ctx_init(&ctx);
+
+	for (first = 0; first < batch->num; first += BATCH_BLOCK) {
+		num = batch->num - first;
+		if (num > BATCH_BLOCK)
+			num = BATCH_BLOCK;
+
+		batch_gather(batch, first, num, &b);
+		batch_kernel(&b, num);
+
+		for (i = 0; i < num; i++) {
+			unsigned int k = first + i;
+
+			feasible[k] = false;
+			if (!b.pass[i]) {
+				skipped++;
+				continue;
+			}
+
+			input.mbus_fmt = batch->mbus_fmt[k];
+			input.refclk = batch->refclk[k];
+			input.link_frequency = batch->link_frequency[k];
+			input.num_lanes = batch->num_lanes[k];
+			input.discontinuous_clk = batch->discontinuous_clk[k];
+			input.pclk = batch->pclk[k];
+			input.width = batch->width[k];
+			input.hblank = batch->hblank[k];
+
+			if (tc358746_ctx_calculate(&ctx, results + k, &input,
+						   NULL) == 0) {
+				feasible[k] = true;
+				found++;
+			}
+		}
+	}
+
+	if (rejected)
+		*rejected = skipped;
+
+	return found;
+}
@@ -0,0 +1,33 @@
+#ifndef TC358746_BATCH_H
+#define TC358746_BATCH_H
+
+#include <stdbool.h>
+#include "tc358746_calculation.h"
+
+/*
+ * Inputs of tc358746_calculate_batch() as structure of arrays, element i of
+ * every array makes the tc358746_input i. The hs->lp->hs model is the same
+ * for the whole batch.
+ */
+struct tc358746_batch {
+	unsigned int num;
+	const u32 *mbus_fmt;
+	const u32 *refclk;
+	const u64 *link_frequency;
+	const u8 *num_lanes;
+	const bool *discontinuous_clk;
+	const u32 *pclk;
+	const u32 *width;
+	const u32 *hblank;
+	enum tc358746_hs_lp_hs_model hs_lp_hs_model;
+	unsigned int hs_lp_hs_margin;
+};
+
+int tc358746_calculate_batch(const struct tc358746_batch *batch,
+			     struct tc358746 *results, bool *feasible,
+			     unsigned int *rejected);
+
+/* the instruction set of the feasibility kernel, e.g. "avx" */
+const char *tc358746_batch_isa(void);
+
+#endif
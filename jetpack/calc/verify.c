@@ -0,0 +1,542 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <linux/bitops.h>
+#include <linux/regmap.h>
+#include "calc.h"
+#include "regmap_mock.h"
+#include "tc358746_batch.h"
+#include "tc358746_calculation.h"
+#include "tc358746_program.h"
+#include "tc358746_regmap.h"
+#include "tc358746_regs.h"
+#include <uapi/linux/media-bus-format.h>
+
+static const u32 verify_formats[] = {
+	MEDIA_BUS_FMT_UYVY8_2X8,
+	MEDIA_BUS_FMT_UYVY8_1X16,
+	MEDIA_BUS_FMT_YUYV8_1X16,
+	MEDIA_BUS_FMT_UYVY10_2X10,
+	MEDIA_BUS_FMT_GBR888_1X24,
+	MEDIA_BUS_FMT_RGB888_1X24,
+	MEDIA_BUS_FMT_SRGGB8_1X8,
+	MEDIA_BUS_FMT_SRGGB10_1X10,
+	MEDIA_BUS_FMT_SRGGB12_1X12,
+	MEDIA_BUS_FMT_SRGGB14_1X14,
+};
+
+static void verify_random_input(uint64_t *state, struct tc358746_input *input)
+{
+	input->mbus_fmt = verify_formats[calc_rand_range(state, 0,
+					 ARRAY_SIZE(verify_formats) - 1)];
+	input->refclk = calc_rand_range(state, 6000000, 40000000);
+	input->link_frequency = calc_rand_range(state, 31250000, 500000000);
+	input->num_lanes = calc_rand_range(state, 1, 4);
+	input->discontinuous_clk = calc_rand_range(state, 0, 1);
+	input->pclk = calc_rand_range(state, 1000, 150000000);
+	input->width = calc_rand_range(state, 1, 8192);
+	input->hblank = calc_rand_range(state, 0, 65535);
+}
+
+/*
+ * Compare the direct fifo size calculation against the reference loop over
+ * every fifo size for random inputs.
+ *
+ * usage: calc verify-fifo [iterations] [seed]
+ */
+int verify_fifo(int argc, char *argv[])
+{
+	unsigned long iterations = argc > 0 ? strtoul(argv[0], NULL, 0) : 1000000;
+	uint64_t state = argc > 1 ? strtoull(argv[1], NULL, 0) : 1;
+	unsigned long i, feasible = 0, mismatches = 0;
+
+	if (!state)
+		state = 1;
+
+	for (i = 0; i < iterations; i++) {
+		struct tc358746_input input;
+		struct tc358746 param, ref;
+		int err, ref_err;
+
+		verify_random_input(&state, &input);
+
+		err = tc358746_calculate(&param, &input);
+		ref_err = tc358746_calculate_ref(&ref, &input);
+
+		if (err == ref_err && (err || param.vb_fifo == ref.vb_fifo)) {
+			feasible += !err;
+			continue;
+		}
+
+		mismatches++;
+		fprintf(stdout,
+			"mismatch: fmt %#x refclk %u link %lu lanes %d %s pclk %u width %u hblank %u: fifo %d/%d, ref %d/%d\n",
+			input.mbus_fmt, input.refclk, input.link_frequency,
+			input.num_lanes,
+			input.discontinuous_clk ? "discont" : "cont",
+			input.pclk, input.width, input.hblank,
+			err, err ? 0 : param.vb_fifo,
+			ref_err, ref_err ? 0 : ref.vb_fifo);
+	}
+
+	fprintf(stdout, "verify-fifo: %lu inputs, %lu feasible, %lu mismatches\n",
+		iterations, feasible, mismatches);
+
+	return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static bool verify_param_equal(const struct tc358746 *a,
+			       const struct tc358746 *b)
+{
+#define eq(field) (a->field == b->field)
+	return eq(format) && eq(pll.pllinclk_hz) && eq(pll.pll_prd) &&
+	       eq(pll.pll_fbd) && eq(csi.speed_range) &&
+	       eq(csi.unit_clk_hz) && eq(csi.unit_clk_mul) &&
+	       eq(csi.speed_per_lane) && eq(csi.lane_num) &&
+	       eq(csi.is_continuous_clk) && eq(csi.lineinitcnt) &&
+	       eq(csi.lptxtimecnt) && eq(csi.twakeupcnt) &&
+	       eq(csi.tclk_preparecnt) && eq(csi.tclk_zerocnt) &&
+	       eq(csi.tclk_trailcnt) && eq(csi.tclk_postcnt) &&
+	       eq(csi.ths_preparecnt) && eq(csi.ths_zerocnt) &&
+	       eq(csi.ths_trailcnt) && eq(csi.csi_hs_lp_hs_ps) &&
+	       eq(vb_fifo);
+#undef eq
+}
+
+/*
+ * Compare the staged calculation against tc358746_calculate() on a random
+ * walk, every step changes the inputs of one or two random stages.
+ *
+ * usage: calc verify-ctx [iterations] [seed]
+ */
+int verify_ctx(int argc, char *argv[])
+{
+	unsigned long iterations = argc > 0 ? strtoul(argv[0], NULL, 0) : 1000000;
+	uint64_t state = argc > 1 ? strtoull(argv[1], NULL, 0) : 1;
+	unsigned long i, feasible = 0, mismatches = 0;
+	struct tc358746_input input = { 0 };
+	struct tc358746_ctx ctx;
+
+	if (!state)
+		state = 1;
+
+	tc358746_ctx_init(&ctx);
+	verify_random_input(&state, &input);
+
+	for (i = 0; i < iterations; i++) {
+		struct tc358746_input next;
+		struct tc358746 param, staged;
+		int err, staged_err, j;
+
+		verify_random_input(&state, &next);
+		next.hs_lp_hs_model = calc_rand_range(&state, 0, 1);
+		next.hs_lp_hs_margin = calc_rand_range(&state, 0, 20);
+
+		for (j = calc_rand_range(&state, 1, 2); j > 0; j--) {
+			switch (calc_rand_range(&state, TC358746_STAGE_FORMAT,
+						TC358746_STAGE_FIFO)) {
+			case TC358746_STAGE_FORMAT:
+				input.mbus_fmt = next.mbus_fmt;
+				input.width = next.width;
+				break;
+			case TC358746_STAGE_PLL:
+				input.refclk = next.refclk;
+				input.link_frequency = next.link_frequency;
+				break;
+			case TC358746_STAGE_LANES:
+				input.num_lanes = next.num_lanes;
+				input.discontinuous_clk = next.discontinuous_clk;
+				break;
+			case TC358746_STAGE_TIMINGS:
+				input.hs_lp_hs_model = next.hs_lp_hs_model;
+				input.hs_lp_hs_margin = next.hs_lp_hs_margin;
+				break;
+			default:
+				if (calc_rand_range(&state, 0, 1))
+					input.pclk = next.pclk;
+				else
+					input.hblank = next.hblank;
+				break;
+			}
+		}
+
+		err = tc358746_calculate(&param, &input);
+		staged_err = tc358746_ctx_calculate(&ctx, &staged, &input, NULL);
+
+		if (err == staged_err &&
+		    (err || verify_param_equal(&param, &staged))) {
+			feasible += !err;
+			continue;
+		}
+
+		mismatches++;
+		fprintf(stdout,
+			"mismatch: fmt %#x refclk %u link %lu lanes %d %s pclk %u width %u hblank %u: %d, staged %d\n",
+			input.mbus_fmt, input.refclk, input.link_frequency,
+			input.num_lanes,
+			input.discontinuous_clk ? "discont" : "cont",
+			input.pclk, input.width, input.hblank, err, staged_err);
+	}
+
+	fprintf(stdout, "verify-ctx: %lu inputs, %lu feasible, %lu mismatches\n",
+		iterations, feasible, mismatches);
+
+	return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* the conditions of tc358746_find_link_freq() at one link frequency */
+static bool verify_link_freq_fits(struct tc358746 *param,
+				  const struct tc358746_input *input)
+{
+	struct tc358746_frame frame;
+
+	if (tc358746_calculate(param, input) < 0)
+		return false;
+
+	if (!input->framerate || !input->height)
+		return true;
+
+	return tc358746_frame_timing(param, input, &frame) == 0 &&
+	       frame.max_framerate >= input->framerate;
+}
+
+/*
+ * Compare the link frequency search against a scan of every multiple of
+ * the resolution over the whole link frequency range for random inputs,
+ * half of them with a frame rate to carry.
+ *
+ * usage: calc verify-link [iterations] [seed] [resolution]
+ */
+int verify_link(int argc, char *argv[])
+{
+	unsigned long iterations = argc > 0 ? strtoul(argv[0], NULL, 0) : 200;
+	uint64_t state = argc > 1 ? strtoull(argv[1], NULL, 0) : 1;
+	u64 resolution = argc > 2 ? strtoull(argv[2], NULL, 0) : 100000;
+	unsigned long i, feasible = 0, mismatches = 0;
+
+	if (!state)
+		state = 1;
+	if (!resolution)
+		return EXIT_FAILURE;
+
+	for (i = 0; i < iterations; i++) {
+		struct tc358746_input input = { 0 };
+		struct tc358746 param, scan;
+		u64 freq, found = 0, lowest = 0;
+		int err;
+
+		verify_random_input(&state, &input);
+		input.pclk = calc_rand_range(&state, 1000000, 150000000);
+		input.width = calc_rand_range(&state, 16, 2048);
+		input.hblank = calc_rand_range(&state, 0, 512);
+		if (calc_rand_range(&state, 0, 1)) {
+			input.height = calc_rand_range(&state, 16, 1536);
+			input.framerate = calc_rand_range(&state, 1, 240) *
+					  1000000;
+		}
+
+		for (freq = (62500000 / 2 + resolution - 1) / resolution;
+		     freq * resolution <= 500000000; freq++) {
+			input.link_frequency = freq * resolution;
+			if (verify_link_freq_fits(&scan, &input)) {
+				lowest = input.link_frequency;
+				break;
+			}
+		}
+
+		err = tc358746_find_link_freq(&param, &input, resolution,
+					      &found);
+		if (err)
+			found = 0;
+
+		if (found == lowest &&
+		    (!found || verify_param_equal(&param, &scan))) {
+			feasible += !!found;
+			continue;
+		}
+
+		mismatches++;
+		fprintf(stdout,
+			"mismatch: fmt %#x refclk %u lanes %d %s pclk %u width %u hblank %u height %u fps %u: %lu, scan %lu\n",
+			input.mbus_fmt, input.refclk, input.num_lanes,
+			input.discontinuous_clk ? "discont" : "cont",
+			input.pclk, input.width, input.hblank, input.height,
+			input.framerate, found, lowest);
+	}
+
+	fprintf(stdout, "verify-link: %lu inputs, %lu feasible, %lu mismatches\n",
+		iterations, feasible, mismatches);
+
+	return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * The writes of @prog one by one, as the driver did before the bursts,
+ * applied to @ctl and @tx. Returns the transactions of the bursts: a write
+ * continues one if it is a plain write to the next register of the same
+ * regmap, and the previous write is plain and has no delay.
+ */
+static unsigned int verify_program_single(const struct tc358746_program *prog,
+					  struct regmap *ctl, struct regmap *tx)
+{
+	const struct tc358746_reg_write *w, *prev = NULL;
+	unsigned int i, transactions = 0;
+	bool pll_keep = false;
+
+	for (i = 0; i < prog->num; i++) {
+		struct regmap *map;
+
+		w = prog->writes + i;
+		map = w->regmap == TC358746_REGMAP_TX ? tx : ctl;
+
+		/* the pll is only written if it changes, see the driver */
+		if (w->regmap == TC358746_REGMAP_CTL && w->addr == PLLCTL0)
+			pll_keep = map->regs[PLLCTL0] == w->val &&
+				   (map->regs[PLLCTL1] & PLLCTL1_PLL_EN_MASK);
+		if (pll_keep && w->regmap == TC358746_REGMAP_CTL &&
+		    (w->addr == PLLCTL0 || w->addr == PLLCTL1)) {
+			prev = NULL;
+			continue;
+		}
+
+		if (!prev || w->mask || prev->mask || prev->delay_us ||
+		    prev->regmap != w->regmap ||
+		    w->addr != prev->addr + map->val_bytes)
+			transactions++;
+		prev = w;
+
+		if (w->mask)
+			regmap_update_bits(map, w->addr, w->mask, w->val);
+		else
+			regmap_write(map, w->addr, w->val);
+	}
+
+	return transactions;
+}
+
+static bool verify_program_log_equal(const struct regmap_mock_log *a,
+				     const struct regmap_mock_log *b)
+{
+	unsigned int i;
+
+	if (a->num != b->num)
+		return false;
+
+	for (i = 0; i < a->num; i++)
+		if (a->writes[i].id != b->writes[i].id ||
+		    a->writes[i].addr != b->writes[i].addr ||
+		    a->writes[i].val != b->writes[i].val)
+			return false;
+
+	return true;
+}
+
+/*
+ * Run the register programs of random inputs through the driver, see
+ * tc358746_run_program(), on regmaps which log every register written.
+ * Every program runs twice, from the reset values and again with the pll
+ * running. The registers and values written have to be the ones of the
+ * program written one by one, in the same order. The I2C transactions
+ * have to be the bursts of consecutive registers.
+ *
+ * usage: calc verify-program [iterations] [seed]
+ */
+int verify_program(int argc, char *argv[])
+{
+	unsigned long iterations = argc > 0 ? strtoul(argv[0], NULL, 0) : 100000;
+	uint64_t state = argc > 1 ? strtoull(argv[1], NULL, 0) : 1;
+	unsigned long i, programs = 0, single = 0, saved = 0, mismatches = 0;
+	static struct regmap ctl, tx, ctl_ref, tx_ref;
+	struct regmap_mock_log log, log_ref;
+
+	if (!state)
+		state = 1;
+
+	for (i = 0; i < iterations; i++) {
+		struct tc358746_input input;
+		struct tc358746_program prog;
+		struct tc358746 param;
+		unsigned int expected;
+		int run, err;
+
+		verify_random_input(&state, &input);
+		if (tc358746_calculate(&param, &input) < 0 ||
+		    tc358746_program(&param, &input, &prog) < 0)
+			continue;
+
+		programs++;
+		regmap_mock_init(&ctl, TC358746_REGMAP_CTL, 2, &log);
+		regmap_mock_init(&tx, TC358746_REGMAP_TX, 4, &log);
+		regmap_mock_init(&ctl_ref, TC358746_REGMAP_CTL, 2, &log_ref);
+		regmap_mock_init(&tx_ref, TC358746_REGMAP_TX, 4, &log_ref);
+
+		for (run = 0; run < 2; run++) {
+			memset(&log, 0, sizeof(log));
+			memset(&log_ref, 0, sizeof(log_ref));
+
+			err = tc358746_run_program(&ctl, &tx, &prog);
+			expected = verify_program_single(&prog, &ctl_ref,
+							 &tx_ref);
+
+			single += log_ref.num;
+			saved += log_ref.num - log.transactions;
+			if (!err && log.transactions == expected &&
+			    verify_program_log_equal(&log, &log_ref))
+				continue;
+
+			mismatches++;
+			fprintf(stdout,
+				"mismatch: fmt %#x refclk %u link %lu lanes %d %s pclk %u width %u hblank %u run %d: %d, %u writes in %u transactions, expected %u in %u\n",
+				input.mbus_fmt, input.refclk,
+				input.link_frequency, input.num_lanes,
+				input.discontinuous_clk ? "discont" : "cont",
+				input.pclk, input.width, input.hblank, run,
+				err, log.num, log.transactions, log_ref.num,
+				expected);
+		}
+	}
+
+	fprintf(stdout,
+		"verify-program: %lu inputs, %lu programs, %lu writes, %lu transactions saved by the bursts, %lu mismatches\n",
+		iterations, programs, single, saved, mismatches);
+
+	return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+static uint64_t verify_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Compare the batch calculation against tc358746_calculate() for random
+ * inputs: the feasibility kernel may reject infeasible inputs only, the
+ * results of the survivors have to be the same.
+ *
+ * usage: calc verify-batch [count] [seed]
+ */
+int verify_batch(int argc, char *argv[])
+{
+	unsigned long num = argc > 0 ? strtoul(argv[0], NULL, 0) : 1000000;
+	uint64_t state = argc > 1 ? strtoull(argv[1], NULL, 0) : 1;
+	unsigned long i, feasible = 0, mismatches = 0;
+	struct tc358746_batch batch = { .num = num };
+	struct tc358746 *results;
+	u32 *mbus_fmt, *refclk, *pclk, *width, *hblank;
+	u64 *link_frequency, batch_ns, scalar_ns, start;
+	bool *discontinuous_clk, *ok;
+	unsigned int rejected;
+	u8 *num_lanes;
+	int found;
+
+	if (!state)
+		state = 1;
+
+	mbus_fmt = calloc(num, sizeof(*mbus_fmt));
+	refclk = calloc(num, sizeof(*refclk));
+	link_frequency = calloc(num, sizeof(*link_frequency));
+	num_lanes = calloc(num, sizeof(*num_lanes));
+	discontinuous_clk = calloc(num, sizeof(*discontinuous_clk));
+	pclk = calloc(num, sizeof(*pclk));
+	width = calloc(num, sizeof(*width));
+	hblank = calloc(num, sizeof(*hblank));
+	results = calloc(num, sizeof(*results));
+	ok = calloc(num, sizeof(*ok));
+	if (!mbus_fmt || !refclk || !link_frequency || !num_lanes ||
+	    !discontinuous_clk || !pclk || !width || !hblank || !results ||
+	    !ok) {
+		perror("calloc");
+		return EXIT_FAILURE;
+	}
+
+	batch.hs_lp_hs_model = calc_rand_range(&state, 0, 1);
+	batch.hs_lp_hs_margin = calc_rand_range(&state, 0, 20);
+	for (i = 0; i < num; i++) {
+		struct tc358746_input input;
+
+		verify_random_input(&state, &input);
+		mbus_fmt[i] = input.mbus_fmt;
+		refclk[i] = input.refclk;
+		link_frequency[i] = input.link_frequency;
+		num_lanes[i] = input.num_lanes;
+		discontinuous_clk[i] = input.discontinuous_clk;
+		pclk[i] = input.pclk;
+		width[i] = input.width;
+		hblank[i] = input.hblank;
+	}
+
+	batch.mbus_fmt = mbus_fmt;
+	batch.refclk = refclk;
+	batch.link_frequency = link_frequency;
+	batch.num_lanes = num_lanes;
+	batch.discontinuous_clk = discontinuous_clk;
+	batch.pclk = pclk;
+	batch.width = width;
+	batch.hblank = hblank;
+
+	start = verify_now_ns();
+	found = tc358746_calculate_batch(&batch, results, ok, &rejected);
+	batch_ns = verify_now_ns() - start;
+
+	scalar_ns = 0;
+	for (i = 0; i < num; i++) {
+		struct tc358746_input input = {
+			.mbus_fmt = mbus_fmt[i],
+			.refclk = refclk[i],
+			.link_frequency = link_frequency[i],
+			.num_lanes = num_lanes[i],
+			.discontinuous_clk = discontinuous_clk[i],
+			.hs_lp_hs_model = batch.hs_lp_hs_model,
+			.hs_lp_hs_margin = batch.hs_lp_hs_margin,
+			.pclk = pclk[i],
+			.width = width[i],
+			.hblank = hblank[i],
+		};
+		struct tc358746 param;
+		int err;
+
+		start = verify_now_ns();
+		err = tc358746_calculate(&param, &input);
+		scalar_ns += verify_now_ns() - start;
+
+		if (!err == ok[i] &&
+		    (err || verify_param_equal(&param, results + i))) {
+			feasible += !err;
+			continue;
+		}
+
+		mismatches++;
+		fprintf(stdout,
+			"mismatch: fmt %#x refclk %u link %lu lanes %d %s pclk %u width %u hblank %u: %d, batch %s\n",
+			input.mbus_fmt, input.refclk, input.link_frequency,
+			input.num_lanes,
+			input.discontinuous_clk ? "discont" : "cont",
+			input.pclk, input.width, input.hblank, err,
+			ok[i] ? "feasible" : "infeasible");
+	}
+
+	fprintf(stdout,
+		"verify-batch: %lu inputs, %lu feasible, %d found, %u rejected by the %s kernel, %lu mismatches\n",
+		num, feasible, found, rejected, tc358746_batch_isa(),
+		mismatches);
+	fprintf(stdout, "verify-batch: batch %.1f ns, scalar %.1f ns per input\n",
+		num ? (double)batch_ns / num : 0.0,
+		num ? (double)scalar_ns / num : 0.0);
+
+	free(ok);
+	free(results);
+	free(hblank);
+	free(width);
+	free(pclk);
+	free(discontinuous_clk);
+	free(num_lanes);
+	free(link_frequency);
+	free(refclk);
+	free(mbus_fmt);
+
+	return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+}
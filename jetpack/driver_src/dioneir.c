@@ -20,7 +20,11 @@
 #include <linux/uaccess.h>
 #include <linux/gpio.h>
 #include <linux/module.h>
+#include <linux/workqueue.h>
+#include <linux/completion.h>
+#include <linux/ktime.h>
 #include <linux/seq_file.h>
+#include <linux/debugfs.h>
 #include <linux/of.h>
 #include <linux/of_graph.h>
 #include <linux/of_device.h>
@@ -33,6 +37,9 @@
 
 #include "tc358746_regs.h"
 #include "tc358746_calculation.h"
+#include "tc358746_program.h"
+#include "tc358746_regmap.h"
+#include "tc358746_modes.h"
 
 #define DIONE_IR_REG_WIDTH_MAX		0x0002f028
 #define DIONE_IR_REG_HEIGHT_MAX		0x0002f02c
@@ -46,7 +53,8 @@
 /* #define DIONE_IR_STARTUP_TMO_MS		1500 */
 /* #define DIONE_IR_HAS_SYSFS		1 */
 
-#define CSI_HSTXVREGCNT			5
+/* a rev A board with two fpga addresses takes about 1.3 s to detect */
+#define DIONE_IR_DETECT_TMO_MS		5000
 
 static int test_mode = 0;
 static int quick_mode = 1;
@@ -99,16 +107,35 @@ static const struct regmap_access_table ctl_regmap_access = {
 	.n_yes_ranges = ARRAY_SIZE(ctl_regmap_rw_ranges),
 };
 
+/*
+ * Chip id, reset, status and debug counters. PP_MISC holds the self
+ * clearing frame stop and pointer reset, a cached update_bits() would
+ * write them again.
+ */
+static const struct regmap_range ctl_regmap_volatile_ranges[] = {
+	regmap_reg_range(CHIPID, SYSCTL),
+	regmap_reg_range(PP_MISC, PP_MISC),
+	regmap_reg_range(MIPI_PHY_STATUS, CSI2_ERROR_STATUS),
+	regmap_reg_range(CSI2_IDID_ERROR, CSI2_IDID_ERROR),
+	regmap_reg_range(DBG_ACT_LINE_CNT, FIFOSTATUS),
+};
+
+static const struct regmap_access_table ctl_regmap_volatile = {
+	.yes_ranges = ctl_regmap_volatile_ranges,
+	.n_yes_ranges = ARRAY_SIZE(ctl_regmap_volatile_ranges),
+};
+
 static const struct regmap_config ctl_regmap_config = {
 	.reg_bits = 16,
 	.reg_stride = 2,
 	.val_bits = 16,
-	.cache_type = REGCACHE_NONE,
+	.cache_type = REGCACHE_RBTREE,
 	.max_register = 0x00ff,
 	.reg_format_endian = REGMAP_ENDIAN_BIG,
 	.val_format_endian = REGMAP_ENDIAN_BIG,
 	.rd_table = &ctl_regmap_access,
 	.wr_table = &ctl_regmap_access,
+	.volatile_table = &ctl_regmap_volatile,
 	.name = "tc358746-ctl",
 };
 
@@ -121,16 +148,33 @@ static const struct regmap_access_table tx_regmap_access = {
 	.n_yes_ranges = ARRAY_SIZE(tx_regmap_rw_ranges),
 };
 
+/*
+ * Triggers and status. CSI_CONTROL is written through CSI_CONFW, the cache
+ * would never see it.
+ */
+static const struct regmap_range tx_regmap_volatile_ranges[] = {
+	regmap_reg_range(STARTCNTRL, STARTCNTRL),
+	regmap_reg_range(CSI_CONTROL, CSI_INT),
+	regmap_reg_range(CSI_ERR, CSI_ERR),
+	regmap_reg_range(CSI_CONFW, CSI_START),
+};
+
+static const struct regmap_access_table tx_regmap_volatile = {
+	.yes_ranges = tx_regmap_volatile_ranges,
+	.n_yes_ranges = ARRAY_SIZE(tx_regmap_volatile_ranges),
+};
+
 static const struct regmap_config tx_regmap_config = {
 	.reg_bits = 16,
 	.reg_stride = 4,
 	.val_bits = 32,
-	.cache_type = REGCACHE_NONE,
+	.cache_type = REGCACHE_RBTREE,
 	.max_register = 0x05ff,
 	.reg_format_endian = REGMAP_ENDIAN_BIG,
 	.val_format_endian = REGMAP_ENDIAN_BIG_LITTLE,
 	.rd_table = &tx_regmap_access,
 	.wr_table = &tx_regmap_access,
+	.volatile_table = &tx_regmap_volatile,
 	.name = "tc358746-tx",
 };
 
@@ -147,6 +191,14 @@ static const u32 ctrl_cid_list[] = {
 	TEGRA_CAMERA_CID_SENSOR_MODE_ID,
 };
 
+/* the bridge configuration of a device tree mode */
+struct dione_ir_mode_cfg {
+	struct tc358746_input		input;	/* with the link frequency */
+	struct tc358746			params;
+	struct tc358746_frame		frame;
+	int				err;	/* the mode can't be set */
+};
+
 struct dione_ir {
 	struct i2c_client		*tc35_client;
 	struct i2c_client		*fpga_client;
@@ -169,6 +221,20 @@ struct dione_ir {
 
 	u64				*link_frequencies;
 	unsigned int			link_frequencies_num;
+
+	/* per device tree mode, see dione_ir_calc_modes() */
+	struct dione_ir_mode_cfg	*mode_cfgs;
+	unsigned int			mode_cfgs_num;
+	struct dentry			*debugfs;
+
+	/* the program the bridge runs, shadow.num is 0 after a reset */
+	struct tc358746_program		shadow;
+
+	/* sensor detection after probe, see dione_ir_detect() */
+	struct work_struct		detect_work;
+	struct completion		detected;
+	int				detect_err;
+	ktime_t				probe_start;
 };
 
 static int dione_ir_i2c_read(struct i2c_client *client, u32 addr, u8 *buf, u16 len);
@@ -232,7 +298,16 @@ static struct tegracam_ctrl_ops dione_ir_ctrl_ops = {
 	.set_group_hold = dione_ir_set_group_hold,
 };
 
-static int dione_ir_power_on(struct camera_common_data *s_data)
+/* a bridge fresh out of reset holds neither the cached nor the shadow values */
+static void dione_ir_bridge_reset(struct camera_common_data *s_data)
+{
+	struct dione_ir *priv = (struct dione_ir *)s_data->priv;
+
+	tc358746_regcache_reset(s_data->regmap, priv->tx_regmap, true);
+	priv->shadow.num = 0;
+}
+
+static int __dione_ir_power_on(struct camera_common_data *s_data)
 {
 	int err = 0;
 	struct camera_common_power_rail *pw = s_data->power;
@@ -244,11 +319,14 @@ static int dione_ir_power_on(struct camera_common_data *s_data)
 	dev_dbg(dev, "%s: power on\n", __func__);
 	if (pdata && pdata->power_on) {
 		err = pdata->power_on(pw);
-		if (err)
+		if (err) {
 			dev_err(dev, "%s failed.\n", __func__);
-		else
-			pw->state = SWITCH_ON;
-		return err;
+			return err;
+		}
+
+		dione_ir_bridge_reset(s_data);
+		pw->state = SWITCH_ON;
+		return 0;
 	}
 
 	if (!priv->quick_mode) {
@@ -294,6 +372,8 @@ skip_power_seqn:
 
 		usleep_range(23000, 23100);
 		msleep(200);
+
+		dione_ir_bridge_reset(s_data);
 	}
 
 	pw->state = SWITCH_ON;
@@ -312,6 +392,33 @@ dione_ir_avdd_fail:
 	return err;
 }
 
+/* the sensor is only usable once dione_ir_detect() has found it */
+static int dione_ir_wait_detected(struct dione_ir *priv)
+{
+	long ret;
+
+	ret = wait_for_completion_interruptible_timeout(&priv->detected,
+				msecs_to_jiffies(DIONE_IR_DETECT_TMO_MS));
+	if (ret < 0)
+		return ret;
+	if (!ret)
+		return -ETIMEDOUT;
+
+	return priv->detect_err;
+}
+
+static int dione_ir_power_on(struct camera_common_data *s_data)
+{
+	struct dione_ir *priv = (struct dione_ir *)s_data->priv;
+	int err;
+
+	err = dione_ir_wait_detected(priv);
+	if (err)
+		return err;
+
+	return __dione_ir_power_on(s_data);
+}
+
 static int dione_ir_power_off(struct camera_common_data *s_data)
 {
 	int err = 0;
@@ -329,6 +436,8 @@ static int dione_ir_power_off(struct camera_common_data *s_data)
 			dev_err(dev, "%s failed\n", __func__);
 			return err;
 		}
+
+		dione_ir_bridge_reset(s_data);
 	} else {
 		if (!priv->quick_mode) {
 			if (pw->reset_gpio) {
@@ -346,6 +455,8 @@ static int dione_ir_power_off(struct camera_common_data *s_data)
 				regulator_disable(pw->iovdd);
 			if (pw->avdd)
 				regulator_disable(pw->avdd);
+
+			dione_ir_bridge_reset(s_data);
 		}
 	}
 
@@ -523,222 +634,179 @@ static inline int tc358746_sleep_mode(struct regmap *regmap, int enable)
 				  enable ? SYSCTL_SLEEP_MASK : 0);
 }
 
-static inline int tc358746_sreset(struct regmap *regmap)
+/*
+ * Calculate the bridge configuration of the device tree mode @sensor_mode:
+ * the first link frequency of the device tree which carries the default
+ * frame rate of the mode.
+ */
+static int dione_ir_calc_mode(struct dione_ir *priv,
+			      const struct sensor_mode_properties *sensor_mode,
+			      struct dione_ir_mode_cfg *cfg)
 {
-	int err;
-
-	err = regmap_write(regmap, SYSCTL, SYSCTL_SRESET_MASK);
-
-	udelay(10);
-
-	if (!err)
-		err = regmap_write(regmap, SYSCTL, 0);
-
-	return err;
-}
+	struct camera_common_data *s_data = priv->s_data;
+	struct device *dev = &priv->tc35_client->dev;
+	const struct camera_common_colorfmt *colorfmt;
+	struct tc358746_input *input = &cfg->input;
+	enum tc358746_prune prune = TC358746_PRUNE_NONE;
+	u64 link_freq_limit = U64_MAX;
+	struct tc358746_diag diag;
+	struct tc358746_ctx ctx;
+	int i, frame_err = 0;
 
-static int tc358746_set_pll(struct regmap *regmap,
-			    const struct tc358746_pll *pll,
-			    const struct tc358746_csi *csi)
-{
-	u32 pllctl0, pllctl1, pllctl0_new;
-	int err;
+	colorfmt = camera_common_find_pixelfmt(sensor_mode->image_properties.pixel_format);
 
-	err = regmap_read(regmap, PLLCTL0, &pllctl0);
-	if (!err)
-		err = regmap_read(regmap, PLLCTL1, &pllctl1);
+	if (!colorfmt) {
+		dev_err(dev, "unsupported pixelformat\n");
+		return -EINVAL;
+	}
 
-	if (err)
-		return err;
+	if (s_data->def_clk_freq != sensor_mode->signal_properties.mclk_freq * 1000) {
+		dev_err(dev, "mclk_freq must be the same in every mode\n");
+		return -EINVAL;
+	}
 
-	pllctl0_new = PLLCTL0_PLL_PRD_SET(pll->pll_prd) |
-	  PLLCTL0_PLL_FBD_SET(pll->pll_fbd);
+	memset(input, 0, sizeof(*input));
+	input->mbus_fmt = colorfmt->code;
+	input->refclk = s_data->def_clk_freq;
+	input->num_lanes = sensor_mode->signal_properties.num_lanes;
+	input->discontinuous_clk = sensor_mode->signal_properties.discontinuous_clk;
+	input->pclk = sensor_mode->signal_properties.pixel_clock.val;
+	input->width = sensor_mode->image_properties.width;
+	input->hblank = sensor_mode->image_properties.line_length - input->width;
+	input->height = sensor_mode->image_properties.height;
+	input->framerate = sensor_mode->control_properties.default_framerate;
 
 	/*
-	 * Only rewrite when needed (new value or disabled), since rewriting
-	 * triggers another format change event.
+	 * The device tree modes are precalculated at build time, calculate
+	 * only the ones missing from the table. The link has to carry the
+	 * default frame rate of the mode too. A failure may rule out the
+	 * link frequencies above it or all of them, skip those. Only the link
+	 * frequency varies, the format stays cached in ctx.
 	 */
-	if (pllctl0 != pllctl0_new || (pllctl1 & PLLCTL1_PLL_EN_MASK) == 0) {
-		u16 pllctl1_mask = PLLCTL1_PLL_FRS_MASK | PLLCTL1_RESETB_MASK |
-				   PLLCTL1_PLL_EN_MASK;
-		u16 pllctl1_val = PLLCTL1_PLL_FRS_SET(csi->speed_range) |
-				  PLLCTL1_RESETB_MASK | PLLCTL1_PLL_EN_MASK;
-
-		err = regmap_write(regmap, PLLCTL0, pllctl0_new);
-		if (!err)
-			err = regmap_update_bits(regmap, PLLCTL1,
-						 pllctl1_mask, pllctl1_val);
-
-		udelay(1000);
-
-		if (!err)
-			err = regmap_update_bits(regmap, PLLCTL1,
-						 PLLCTL1_CKEN_MASK,
-						 PLLCTL1_CKEN_MASK);
-	}
-
-	return err;
-}
+	tc358746_ctx_init(&ctx);
+	diag.reason = TC358746_REASON_NONE;
+	for (i = 0; i < priv->link_frequencies_num; i++) {
+		input->link_frequency = priv->link_frequencies[i];
+		if (input->link_frequency >= link_freq_limit)
+			continue;
+
+		if (tc358746_lookup(&cfg->params, input, tc358746_modes,
+				    ARRAY_SIZE(tc358746_modes)) < 0 &&
+		    tc358746_ctx_calculate(&ctx, &cfg->params, input,
+					   &diag) < 0) {
+			frame_err = 0;
+			prune = tc358746_diag_prune(&diag);
+			if (prune == TC358746_PRUNE_ALL)
+				break;
+			if (prune == TC358746_PRUNE_ABOVE)
+				link_freq_limit = input->link_frequency;
+			continue;
+		}
+		frame_err = tc358746_frame_timing(&cfg->params, input,
+						  &cfg->frame);
+		if (frame_err < 0)
+			continue;
+		if (cfg->frame.max_framerate >= input->framerate)
+			break;
 
-static int tc358746_set_csi_color_space(struct regmap *regmap,
-					const struct tc358746_mbus_fmt *format)
-{
-	int err;
+		diag.reason = TC358746_REASON_FRAMERATE;
+		diag.value = cfg->frame.max_framerate;
+		diag.bound = input->framerate;
+	}
 
-	err = regmap_update_bits(regmap, DATAFMT,
-				 (DATAFMT_PDFMT_MASK | DATAFMT_UDT_EN_MASK),
-				 DATAFMT_PDFMT_SET(format->pdformat));
+	/* diag is of the last calculation, which passed if the frame timing failed */
+	if (frame_err < 0 && i >= priv->link_frequencies_num) {
+		dev_err(dev, "could not calculate the frame timing of %ux%u: %d\n",
+			input->width, input->height, frame_err);
+		return -EINVAL;
+	}
 
-	if (!err)
-		err = regmap_update_bits(regmap, CONFCTL, CONFCTL_PDATAF_MASK,
-					 CONFCTL_PDATAF_SET(format->pdataf));
+	if (i >= priv->link_frequencies_num || prune == TC358746_PRUNE_ALL) {
+		dev_err(dev,
+			"could not calculate parameters for tc358746: %s, %llu vs %llu\n",
+			tc358746_reason_str(diag.reason), diag.value, diag.bound);
+		return -EINVAL;
+	}
 
-	return err;
+	return 0;
 }
 
-static int tc358746_set_buffers(struct regmap *regmap,
-				u32 width, u8 bpp, u16 vb_fifo)
+/*
+ * Calculate every device tree mode once at probe, so stream start only looks
+ * the configuration up and a mode the link can't carry shows up at boot.
+ */
+static int dione_ir_calc_modes(struct dione_ir *priv)
 {
-	unsigned int byte_per_line = (width * bpp) / 8;
-	int err;
+	const struct sensor_properties *props = &priv->s_data->sensor_props;
+	struct device *dev = &priv->tc35_client->dev;
+	struct dione_ir_mode_cfg *cfg;
+	int i;
 
-	err = regmap_write(regmap, FIFOCTL, vb_fifo);
+	priv->mode_cfgs = devm_kcalloc(dev, props->num_modes,
+				       sizeof(*priv->mode_cfgs), GFP_KERNEL);
+	if (!priv->mode_cfgs)
+		return -ENOMEM;
+	priv->mode_cfgs_num = props->num_modes;
 
-	if (!err)
-		err = regmap_write(regmap, WORDCNT, byte_per_line);
+	for (i = 0; i < props->num_modes; i++) {
+		cfg = priv->mode_cfgs + i;
+		cfg->err = dione_ir_calc_mode(priv, props->sensor_modes + i, cfg);
+		if (cfg->err)
+			dev_err(dev, "mode %d can't be set\n", i);
+	}
 
-	return err;
+	return 0;
 }
 
-static int tc358746_enable_csi_lanes(struct regmap *regmap,
-				     int lane_num, int enable)
+/* debugfs ".../modes": the link frequency chosen for every mode */
+static int dione_ir_modes_show(struct seq_file *s, void *data)
 {
-	u32 val = 0;
-	int err = 0;
-
-	if (lane_num < 1 || !enable) {
-		if (!err)
-			err = regmap_write(regmap, CLW_CNTRL,
-					   CLW_CNTRL_CLW_LANEDISABLE_MASK);
-		if (!err)
-			err = regmap_write(regmap, D0W_CNTRL,
-					   D0W_CNTRL_D0W_LANEDISABLE_MASK);
-	}
-
-	if (lane_num < 2 || !enable) {
-		if (!err)
-			err = regmap_write(regmap, D1W_CNTRL,
-					   D1W_CNTRL_D1W_LANEDISABLE_MASK);
-	}
-
-	if (lane_num < 3 || !enable) {
-		if (!err)
-			err = regmap_write(regmap, D2W_CNTRL,
-					   D2W_CNTRL_D2W_LANEDISABLE_MASK);
-	}
-
-	if (lane_num < 4 || !enable) {
-		if (!err)
-			err = regmap_write(regmap, D3W_CNTRL,
-					   D2W_CNTRL_D3W_LANEDISABLE_MASK);
-	}
+	struct dione_ir *priv = s->private;
+	const struct dione_ir_mode_cfg *cfg;
+	int i;
+
+	for (i = 0; i < priv->mode_cfgs_num; i++) {
+		cfg = priv->mode_cfgs + i;
+		if (cfg->err) {
+			seq_printf(s, "%d: error %d\n", i, cfg->err);
+			continue;
+		}
 
-	if (lane_num > 0 && enable) {
-		val |= HSTXVREGEN_CLM_HSTXVREGEN_MASK |
-			HSTXVREGEN_D0M_HSTXVREGEN_MASK;
+		seq_printf(s, "%d: %ux%u link %llu Hz, vb_fifo %u, %llu.%06llu fps\n",
+			   i, cfg->input.width, cfg->input.height,
+			   cfg->input.link_frequency, cfg->params.vb_fifo,
+			   cfg->frame.framerate / 1000000,
+			   cfg->frame.framerate % 1000000);
 	}
 
-	if (lane_num > 1 && enable)
-		val |= HSTXVREGEN_D1M_HSTXVREGEN_MASK;
-
-	if (lane_num > 2 && enable)
-		val |= HSTXVREGEN_D2M_HSTXVREGEN_MASK;
-
-	if (lane_num > 3 && enable)
-		val |= HSTXVREGEN_D3M_HSTXVREGEN_MASK;
-
-	if (!err)
-		err = regmap_write(regmap, HSTXVREGEN, val);
-
-	return err;
+	return 0;
 }
 
-static int tc358746_set_csi(struct regmap *regmap,
-			    const struct tc358746_csi *csi)
+static int dione_ir_modes_open(struct inode *inode, struct file *file)
 {
-	u32 val;
-	int err;
-
-	val = TCLK_HEADERCNT_TCLK_ZEROCNT_SET(csi->tclk_zerocnt) |
-	      TCLK_HEADERCNT_TCLK_PREPARECNT_SET(csi->tclk_preparecnt);
-	err = regmap_write(regmap, TCLK_HEADERCNT, val);
-
-	val = THS_HEADERCNT_THS_ZEROCNT_SET(csi->ths_zerocnt) |
-	      THS_HEADERCNT_THS_PREPARECNT_SET(csi->ths_preparecnt);
-	if (!err)
-		err = regmap_write(regmap, THS_HEADERCNT, val);
-
-	if (!err)
-		err = regmap_write(regmap, TWAKEUP, csi->twakeupcnt);
-
-	if (!err)
-		err = regmap_write(regmap, TCLK_POSTCNT, csi->tclk_postcnt);
-
-	if (!err)
-		err = regmap_write(regmap, THS_TRAILCNT, csi->ths_trailcnt);
-
-	if (!err)
-		err = regmap_write(regmap, LINEINITCNT, csi->lineinitcnt);
-
-	if (!err)
-		err = regmap_write(regmap, LPTXTIMECNT, csi->lptxtimecnt);
-
-	if (!err)
-		err = regmap_write(regmap, TCLK_TRAILCNT, csi->tclk_trailcnt);
-
-	if (!err)
-		err = regmap_write(regmap, HSTXVREGCNT, CSI_HSTXVREGCNT);
-
-	val = csi->is_continuous_clk ? TXOPTIONCNTRL_CONTCLKMODE_MASK : 0;
-	if (!err)
-		err = regmap_write(regmap, TXOPTIONCNTRL, val);
-
-	return err;
+	return single_open(file, dione_ir_modes_show, inode->i_private);
 }
 
-static int tc358746_wr_csi_control(struct regmap *regmap, u32 val)
-{
-	val &= CSI_CONFW_DATA_MASK;
-	val |= CSI_CONFW_MODE_SET_MASK | CSI_CONFW_ADDRESS_CSI_CONTROL_MASK;
-
-	return regmap_write(regmap, CSI_CONFW, val);
-}
+static const struct file_operations dione_ir_modes_fops = {
+	.owner = THIS_MODULE,
+	.open = dione_ir_modes_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
 
-static int tc358746_enable_csi_module(struct regmap *regmap, int lane_num)
+static void dione_ir_debugfs_create(struct dione_ir *priv)
 {
-	u32 val;
-	int err;
-
-	err = regmap_write(regmap, STARTCNTRL, STARTCNTRL_START_MASK);
-
-	if (!err)
-		err = regmap_write(regmap, CSI_START, CSI_START_STRT_MASK);
-
-	val = CSI_CONTROL_NOL_1_MASK;
-	if (lane_num == 2)
-		val = CSI_CONTROL_NOL_2_MASK;
-	else if (lane_num == 3)
-		val = CSI_CONTROL_NOL_3_MASK;
-	else if (lane_num == 4)
-		val = CSI_CONTROL_NOL_4_MASK;
-
-	val |= CSI_CONTROL_CSI_MODE_MASK | CSI_CONTROL_TXHSMD_MASK |
-		CSI_CONTROL_EOTDIS_MASK; /* add, according to Excel */
+	struct device *dev = &priv->tc35_client->dev;
 
-	if (!err)
-		err = tc358746_wr_csi_control(regmap, val);
+	priv->debugfs = debugfs_create_dir(dev_name(dev), NULL);
+	if (IS_ERR_OR_NULL(priv->debugfs)) {
+		priv->debugfs = NULL;
+		return;
+	}
 
-	return err;
+	debugfs_create_file("modes", 0444, priv->debugfs, priv,
+			    &dione_ir_modes_fops);
 }
 
 static int dione_ir_set_mode(struct tegracam_device *tc_dev)
@@ -748,45 +816,32 @@ static int dione_ir_set_mode(struct tegracam_device *tc_dev)
 	struct regmap *ctl_regmap = s_data->regmap;
 	struct regmap *tx_regmap = priv->tx_regmap;
 	const struct sensor_mode_properties *sensor_mode;
-	const struct camera_common_colorfmt *colorfmt;
-	struct tc358746_input input;
-	struct tc358746 params;
-	int i, err;
+	const struct dione_ir_mode_cfg *cfg;
+	struct tc358746_program prog, delta;
+	unsigned int skipped;
+	int err;
+
+	/* priv->mode is the detected mode */
+	err = dione_ir_wait_detected(priv);
+	if (err)
+		return err;
 
 	if (s_data->mode != priv->mode)
 		return -EINVAL;
 
 	sensor_mode = s_data->sensor_props.sensor_modes + s_data->mode_prop_idx;
-	colorfmt = camera_common_find_pixelfmt(sensor_mode->image_properties.pixel_format);
-
-	if (!colorfmt) {
-		dev_err(tc_dev->dev, "unsupported pixelformat\n");
-		return -EINVAL;
-	}
-
-	if (s_data->def_clk_freq != sensor_mode->signal_properties.mclk_freq * 1000) {
-		dev_err(tc_dev->dev, "mclk_freq must be the same in every mode\n");
-		return -EINVAL;
-	}
-
-	input.mbus_fmt = colorfmt->code;
-	input.refclk = s_data->def_clk_freq;
-	input.num_lanes = sensor_mode->signal_properties.num_lanes;
-	input.discontinuous_clk = sensor_mode->signal_properties.discontinuous_clk;
-	input.pclk = sensor_mode->signal_properties.pixel_clock.val;
-	input.width = sensor_mode->image_properties.width;
-	input.hblank = sensor_mode->image_properties.line_length - input.width;
-
-	for (i = 0; i < priv->link_frequencies_num; i++) {
-		input.link_frequency = priv->link_frequencies[i];
-		if (tc358746_calculate(&params, &input) == 0)
-			break;
-	}
-
-	if (i >= priv->link_frequencies_num) {
-		dev_err(tc_dev->dev, "could not calculate parameters for tc358746\n");
-		return -EINVAL;
-	}
+	cfg = priv->mode_cfgs + (sensor_mode - s_data->sensor_props.sensor_modes);
+	if (cfg->err)
+		return cfg->err;
+
+	dev_dbg(tc_dev->dev,
+		"link %llu Hz: %llu.%06llu fps, max %llu.%06llu fps, link %u.%02u%% used\n",
+		cfg->input.link_frequency,
+		cfg->frame.framerate / 1000000, cfg->frame.framerate % 1000000,
+		cfg->frame.max_framerate / 1000000,
+		cfg->frame.max_framerate % 1000000,
+		cfg->frame.link_utilisation / 100,
+		cfg->frame.link_utilisation % 100);
 
 	err = 0;
 	if (test_mode) {
@@ -815,36 +870,26 @@ static int dione_ir_set_mode(struct tegracam_device *tc_dev)
 	regmap_write(ctl_regmap, DBG_ACT_LINE_CNT, 0);
 
 	if (!err)
-		err = tc358746_sreset(ctl_regmap);
-	if (err) {
-		dev_err(tc_dev->dev, "Failed to reset chip\n");
-		return err;
-	}
+		err = tc358746_program(&cfg->params, &cfg->input, &prog);
 
-	err = tc358746_set_pll(ctl_regmap, &params.pll, &params.csi);
-	if (err) {
-		dev_err(tc_dev->dev, "Failed to setup PLL\n");
-		return err;
+	/*
+	 * With the pll and the lanes as they are, the bridge needs neither
+	 * the software reset nor the pll relock, only the control registers
+	 * which differ from the running program and the tx registers the
+	 * csi reset of the stream stop cleared.
+	 */
+	if (!err) {
+		skipped = tc358746_program_delta(&priv->shadow, &prog, &delta);
+		dev_dbg(tc_dev->dev, "%u of %u writes skipped\n", skipped,
+			prog.num);
+		err = tc358746_run_program(ctl_regmap, tx_regmap, &delta);
 	}
 
-	err = tc358746_set_csi_color_space(ctl_regmap, params.format);
-
-	if (!err)
-		err = tc358746_set_buffers(ctl_regmap, input.width,
-				           params.format->bpp, params.vb_fifo);
-
-	if (!err)
-		err = tc358746_enable_csi_lanes(tx_regmap,
-						params.csi.lane_num, true);
-
-	if (!err)
-		err = tc358746_set_csi(tx_regmap, &params.csi);
-
+	/* a failed program leaves the bridge in an unknown state */
+	priv->shadow.num = 0;
 	if (!err)
-		err = tc358746_enable_csi_module(tx_regmap,
-						 params.csi.lane_num);
-
-	if (err)
+		priv->shadow = prog;
+	else
 		dev_err(tc_dev->dev, "%s return code (%d)\n", __func__, err);
 
 	return err;
@@ -1164,7 +1209,7 @@ static int dione_ir_board_setup(struct dione_ir *priv)
 
 	_quick_mode = priv->quick_mode;
 	priv->quick_mode = 0;
-	err = s_data->ops->power_on(s_data);
+	err = __dione_ir_power_on(s_data);
 	priv->quick_mode = _quick_mode;
 
 #ifdef DIONE_IR_STARTUP_TMO_MS
@@ -1213,12 +1258,65 @@ done:
 	return err;
 }
 
+/*
+ * Power up the bridge, check its chip id and look for the fpga at every
+ * address, the second time with the reva power sequence. This sleeps for
+ * half a second or more, so it runs from a work item instead of the probe.
+ * The power_on and open callbacks wait for it.
+ */
+static void dione_ir_detect(struct dione_ir *priv)
+{
+	struct device *dev = &priv->tc35_client->dev;
+	ktime_t start = ktime_get();
+	int err;
+
+	err = dione_ir_board_setup(priv);
+	if (err && !priv->tc35_found && !priv->fpga_found) {
+		priv->reva = true;
+		err = dione_ir_board_setup(priv);
+	}
+
+	if (!test_mode && priv->fpga_client != NULL) {
+		i2c_unregister_device(priv->fpga_client);
+		priv->fpga_client = NULL;
+	}
+
+	if (err) {
+		if (!priv->tc35_found && !priv->fpga_found)
+			dev_err(dev, "no dione-ir sensor found\n");
+		else if (priv->tc35_found && !priv->fpga_found)
+			dev_err(dev, "no fpga found, please install it\n");
+		else
+			dev_err(dev, "dione_ir_board_setup error: %d\n", err);
+		err = -ENODEV;
+	} else {
+		dev_info(dev, "detected dione-ir sensor%s%s%s%s\n",
+			 priv->reva ? " (reva)" : "",
+			 test_mode || quick_mode ? ", mode:" : "",
+			 test_mode ? " test" : "",
+			 quick_mode ? " quick" : "");
+	}
+
+	dev_dbg(dev, "detection took %lld ms, %lld ms after the probe began\n",
+		ktime_ms_delta(ktime_get(), start),
+		ktime_ms_delta(ktime_get(), priv->probe_start));
+
+	priv->detect_err = err;
+	complete_all(&priv->detected);
+}
+
+static void dione_ir_detect_work(struct work_struct *work)
+{
+	dione_ir_detect(container_of(work, struct dione_ir, detect_work));
+}
+
 static int dione_ir_open(struct v4l2_subdev *sd, struct v4l2_subdev_fh *fh)
 {
 	struct i2c_client *client = v4l2_get_subdevdata(sd);
+	struct camera_common_data *s_data = to_camera_common_data(&client->dev);
 
 	dev_dbg(&client->dev, "%s:\n", __func__);
-	return 0;
+	return dione_ir_wait_detected((struct dione_ir *)s_data->priv);
 }
 
 static const struct v4l2_subdev_internal_ops dione_ir_subdev_internal_ops = {
@@ -1266,28 +1364,11 @@ static struct tegracam_device *dione_ir_probe_sensor(struct dione_ir *priv)
 		}
 	}
 
-	if (!err) {
-		err = dione_ir_board_setup(priv);
-		if (err && !priv->tc35_found && !priv->fpga_found) {
-			priv->reva = true;
-			err = dione_ir_board_setup(priv);
-		}
-
-		if (err && priv->tc35_found && priv->fpga_found)
-			dev_err(dev, "dione_ir_board_setup error: %d\n", err);
-	}
-
-	if (err) {
-		if (tc_dev)
-			tegracam_device_unregister(tc_dev);
+	if (err && tc_dev) {
+		tegracam_device_unregister(tc_dev);
 		tc_dev = NULL;
 	}
 
-	if (!test_mode && priv->fpga_client != NULL) {
-		i2c_unregister_device(priv->fpga_client);
-		priv->fpga_client = NULL;
-	}
-
 	return tc_dev;
 }
 
@@ -1425,6 +1506,8 @@ static int dione_ir_probe(struct i2c_client *client,
 	if (!priv)
 		return -ENOMEM;
 
+	priv->probe_start = ktime_get();
+
 	err = dione_ir_parse_fpga_address(client, priv);
 	if (err < 0)
 		return err;
@@ -1437,17 +1520,21 @@ static int dione_ir_probe(struct i2c_client *client,
 	if (test_mode)
 		quick_mode = 1;
 
+	INIT_WORK(&priv->detect_work, dione_ir_detect_work);
+	init_completion(&priv->detected);
+
 	tc_dev = dione_ir_probe_sensor(priv);
 	if (!tc_dev) {
-		if (!priv->tc35_found && !priv->fpga_found)
-			dev_err(dev, "no dione-ir sensor found\n");
-		else if (priv->tc35_found && !priv->fpga_found)
-			dev_err(dev, "no fpga found, please install it\n");
-		else
-			dev_err(dev, "dione-ir probe error\n");
+		dev_err(dev, "dione-ir probe error\n");
 		return -ENODEV;
 	}
 
+	err = dione_ir_calc_modes(priv);
+	if (err) {
+		tegracam_device_unregister(tc_dev);
+		return err;
+	}
+
 	err = tegracam_v4l2subdev_register(tc_dev, true);
 	if (err) {
 		dev_err(dev, "tegra camera subdev registration failed\n");
@@ -1455,13 +1542,13 @@ static int dione_ir_probe(struct i2c_client *client,
 		return err;
 	}
 
-	dev_info(dev, "detected dione-ir sensor%s%s%s%s\n",
-		 priv->reva ? " (reva)" : "",
-		 test_mode || quick_mode ? ", mode:" : "",
-		 test_mode ? " test" : "",
-		 quick_mode ? " quick" : "");
+	/* the cameras of a board detect in parallel, off the boot path */
+	schedule_work(&priv->detect_work);
+	dev_dbg(dev, "probe took %lld ms\n",
+		ktime_ms_delta(ktime_get(), priv->probe_start));
 
 	dione_ir_sysfs_create(client, priv);
+	dione_ir_debugfs_create(priv);
 
 	return 0;
 }
@@ -1471,10 +1558,13 @@ static int dione_ir_remove(struct i2c_client *client)
 	struct camera_common_data *s_data = to_camera_common_data(&client->dev);
 	struct dione_ir *priv = (struct dione_ir *)s_data->priv;
 
+	flush_work(&priv->detect_work);
+
 	tegracam_v4l2subdev_unregister(priv->tc_dev);
 	tegracam_device_unregister(priv->tc_dev);
 
 	dione_ir_sysfs_remove(client);
+	debugfs_remove_recursive(priv->debugfs);
 
 	return 0;
 }
@@ -1490,6 +1580,7 @@ static struct i2c_driver dione_ir_i2c_driver = {
 		.name = "dioneir",
 		.owner = THIS_MODULE,
 		.of_match_table = of_match_ptr(dione_ir_of_match),
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe = dione_ir_probe,
 	.remove = dione_ir_remove,
@@ -23,6 +23,28 @@
 #define CONFCTL_PDATAF_MODE0		0
 #define TC358746_MAX_FIFO_SIZE		512
 
+#define TC358746_LANE_RATE_MIN		62500000U
+#define TC358746_LANE_RATE_MAX		1000000000U
+#define TC358746_HSBYTECLK_MAX		125000000U
+#define TC358746_PCLK_MAX		166000000U
+
+#define TC358746_PLLINCLK_MIN		4000000U
+#define TC358746_PLLINCLK_MAX		40000000U
+#define TC358746_VCO_MIN		500000000ULL
+#define TC358746_VCO_MAX		1000000000ULL
+#define TC358746_PLL_PRD_MAX		16
+#define TC358746_PLL_FBD_MAX		512
+#define TC358746_PLL_FRS_MAX		3
+
+#define TC358746_FS_PER_S		1000000000000000ULL
+#define TC358746_FS_PER_NS		1000000ULL
+/* 1 s in ps times the fps scale of the device tree (framerate_factor) */
+#define TC358746_PS_PER_FPS		(1000000000000ULL * 1000000)
+
+/* The timing model is 64-bit, all products are checked for overflow. */
+#define tc358746_mul_overflow(a, b, d)	__builtin_mul_overflow(a, b, d)
+#define tc358746_add_overflow(a, b, d)	__builtin_add_overflow(a, b, d)
+
 #define TC358746_LINEINIT_MIN_US	110
 #define TC358746_TWAKEUP_MIN_US		1200
 #define TC358746_LPTXTIME_MIN_NS	55
@@ -32,18 +54,32 @@
 #define TC358746_THSZERO_MIN_NS		150
 #define TC358746_THSTRAIL_MIN_NS	65
 #define TC358746_THSPREPARE_MIN_NS	45
+#define TC358746_THSEXIT_MIN_NS		100
 
 #ifdef TC358746_DEFINE_LOGS
 #include "tc358746_logs.h"
 #endif
 
 #ifndef log_error
-#define log_error(fmt, args...)
+#define log_error(fmt, args...)	do { } while (0)
 #endif
 #ifndef log_info
-#define log_info(fmt, args...)
+#define log_info(fmt, args...)	do { } while (0)
 #endif
 
+/* record why a stage failed, if the caller asked for it */
+static int tc358746_fail(struct tc358746_diag *diag,
+			 enum tc358746_reason reason, u64 value, u64 bound)
+{
+	if (diag) {
+		diag->reason = reason;
+		diag->value = value;
+		diag->bound = bound;
+	}
+
+	return -EINVAL;
+}
+
 /* TODO: Add other formats as required */
 static const struct tc358746_mbus_fmt tc358746_formats[] = {
 	{
@@ -90,6 +126,34 @@ static const struct tc358746_mbus_fmt tc358746_formats[] = {
 		.pdformat = DATAFMT_PDFMT_RGB888,
 		.pdataf = CONFCTL_PDATAF_MODE0,
 		.ppp = 1,
+	}, {
+		.code = MEDIA_BUS_FMT_SRGGB8_1X8,
+		.bus_width = 8,
+		.bpp = 8,
+		.pdformat = DATAFMT_PDFMT_RAW8,
+		.pdataf = CONFCTL_PDATAF_MODE0, /* don't care */
+		.ppp = 1,
+	}, {
+		.code = MEDIA_BUS_FMT_SRGGB10_1X10,
+		.bus_width = 10,
+		.bpp = 10,
+		.pdformat = DATAFMT_PDFMT_RAW10,
+		.pdataf = CONFCTL_PDATAF_MODE0, /* don't care */
+		.ppp = 1,
+	}, {
+		.code = MEDIA_BUS_FMT_SRGGB12_1X12,
+		.bus_width = 12,
+		.bpp = 12,
+		.pdformat = DATAFMT_PDFMT_RAW12,
+		.pdataf = CONFCTL_PDATAF_MODE0, /* don't care */
+		.ppp = 1,
+	}, {
+		.code = MEDIA_BUS_FMT_SRGGB14_1X14,
+		.bus_width = 14,
+		.bpp = 14,
+		.pdformat = DATAFMT_PDFMT_RAW14,
+		.pdataf = CONFCTL_PDATAF_MODE0, /* don't care */
+		.ppp = 1,
 	},
 };
 
@@ -104,76 +168,244 @@ static const struct tc358746_mbus_fmt *tc358746_get_format(u32 code)
 	return NULL;
 }
 
-static int tc358746_adjust_fifo_size(const struct tc358746_input *input,
-				     const struct tc358746_mbus_fmt *format,
-				     struct tc358746_csi *csi_settings,
-				     u16 *fifo_size)
-{
-	int c_hactive_ps_diff, c_lp_active_ps_diff, c_fifo_delay_ps_diff;
-	unsigned int p_hactive_ps, p_hblank_ps, p_htotal_ps;
-	unsigned int c_hactive_ps, c_lp_active_ps, c_fifo_delay_ps;
-	unsigned int csi_bps, csi_bps_period_ps;
-	unsigned int csi_hsclk, csi_hsclk_period_ps;
-	unsigned int pclk_period_ps;
-	unsigned int _fifo_size;
+/* the format description of @code, NULL if it isn't supported */
+const struct tc358746_mbus_fmt *tc358746_find_format(u32 code)
+{
+	return tc358746_get_format(code);
+}
 
-	pclk_period_ps = 1000000000 / (input->pclk / 1000);
-	csi_bps = csi_settings->speed_per_lane * csi_settings->lane_num;
-	csi_bps_period_ps = 1000000000 / (csi_bps / 1000);
+/*
+ * Durations are whole clock cycles and kept in fs as
+ * cycles * 10^15 / clock_hz, rounded down once. The error stays below 1 fs
+ * however many cycles a line has, unlike with a clock period rounded to
+ * whole ps first and multiplied up.
+ */
+static u64 tc358746_fs(u64 cycles, u64 hz)
+{
+	return cycles * (TC358746_FS_PER_S / hz) +
+	       cycles * (TC358746_FS_PER_S % hz) / hz;
+}
+
+/* tc358746_fs() for any number of cycles */
+static int tc358746_cycles_fs(u64 cycles, u64 hz, u64 *fs)
+{
+	u64 whole, part;
+
+	if (tc358746_mul_overflow(cycles, TC358746_FS_PER_S / hz, &whole) ||
+	    tc358746_mul_overflow(cycles, TC358746_FS_PER_S % hz, &part) ||
+	    tc358746_add_overflow(whole, part / hz, fs))
+		return -EOVERFLOW;
+
+	return 0;
+}
+
+/* the fewest cycles of @hz lasting longer than @fs */
+static u64 tc358746_cycles_above(u64 fs, u64 hz)
+{
+	u64 cycles, d;
+
+	/* the period is at most 1 fs short, the estimate is never too low */
+	cycles = fs / (TC358746_FS_PER_S / hz) + 1;
+	while (cycles > 1 && !tc358746_cycles_fs(cycles - 1, hz, &d) && d > fs)
+		cycles--;
+
+	return cycles;
+}
+
+/* a - b in ps, rounded away from 0 so only a == b gives 0 */
+static s64 tc358746_slack_ps(u64 a_fs, u64 b_fs)
+{
+	if (a_fs >= b_fs)
+		return DIV_ROUND_UP(a_fs - b_fs, 1000);
+
+	return -(s64)DIV_ROUND_UP(b_fs - a_fs, 1000);
+}
+
+struct tc358746_line_timing {
+	u64 pclk;		/* Hz */
+	u64 pclk_bits;		/* pclk * parallel_bus_width, bps */
+	u64 p_hactive_fs;
+	u64 p_htotal_fs;
+	u64 c_data_fs;
+	u64 c_start_fs;		/* 4 * csi_hsclk_period */
+	u64 c_hs_lp_hs_fs;
+};
+
+static int tc358746_get_line_timing(const struct tc358746_input *input,
+				    const struct tc358746_mbus_fmt *format,
+				    const struct tc358746_csi *csi_settings,
+				    struct tc358746_line_timing *t)
+{
+	u64 csi_bps, csi_hsclk, p_hactive, c_data;
+
+	if (input->pclk < 1000) {
+		log_error("unsupported pclk %u Hz\n", input->pclk);
+		return -EINVAL;
+	}
+
+	t->pclk = input->pclk;
+	t->pclk_bits = (u64)input->pclk * format->bus_width;
+	csi_bps = (u64)csi_settings->speed_per_lane * csi_settings->lane_num;
 	csi_hsclk = csi_settings->speed_per_lane >> 3;
-	csi_hsclk_period_ps = 1000000000 / (csi_hsclk / 1000);
+	t->c_start_fs = tc358746_fs(4, csi_hsclk);
+	t->c_hs_lp_hs_fs = csi_settings->csi_hs_lp_hs_ps * 1000;
+
+	/*
+	 * Calculation:
+	 * p_hactive = pclk_period * pclk_per_pixel * h_active_pixel
+	 * p_htotal = pclk_period * (pclk_per_pixel * h_active_pixel +
+	 *			     h_blank_pixel)
+	 */
+	p_hactive = (u64)format->ppp * input->width;
+	if (tc358746_cycles_fs(p_hactive, t->pclk, &t->p_hactive_fs) ||
+	    tc358746_cycles_fs(p_hactive + input->hblank, t->pclk,
+			       &t->p_htotal_fs))
+		goto overflow;
 
 	/*
 	 * Calculation:
-	 * p_hactive_ps = pclk_period_ps * pclk_per_pixel * h_active_pixel
+	 * c_data = csi_bps_period * image_bpp * h_active_pixel
 	 */
-	p_hactive_ps = pclk_period_ps * format->ppp * input->width;
+	c_data = (u64)format->bpp * input->width;
+	if (tc358746_cycles_fs(c_data, csi_bps, &t->c_data_fs))
+		goto overflow;
+
+	return 0;
+
+overflow:
+	log_error("line timing overflow: pclk %u Hz, width %u, hblank %u\n",
+		  input->pclk, input->width, input->hblank);
+	return -EOVERFLOW;
+}
+
+static int tc358746_get_c_hactive(const struct tc358746_line_timing *t,
+				  unsigned int fifo_size, u64 *c_hactive_fs)
+{
+	u64 c_fifo_delay_fs;
 
 	/*
 	 * Calculation:
-	 * p_hblank_ps = pclk_period_ps * h_blank_pixel
+	 * c_fifo_delay = (fifo_size * 32) / parallel_bus_width *
+	 *                pclk_period + 4 * csi_hsclk_period
+	 *
+	 * Can't overflow: fifo_size < 512 and pclk >= 1 kHz.
 	 */
-	p_hblank_ps = pclk_period_ps * input->hblank;
-	p_htotal_ps = p_hblank_ps + p_hactive_ps;
+	c_fifo_delay_fs = tc358746_fs(fifo_size * 32, t->pclk_bits);
+	c_fifo_delay_fs += t->c_start_fs;
 
 	/*
-	 * Adjust the fifo size to adjust the csi timing. Hopefully we can find
-	 * a fifo size where the parallel input timings and the csi tx timings
-	 * fit together.
+	 * Calculation:
+	 * c_hactive = csi_bps_period * image_bpp * h_active_pixel
+	 *             + c_fifo_delay
 	 */
-	for (_fifo_size = 1; _fifo_size < TC358746_MAX_FIFO_SIZE; _fifo_size++) {
-		/*
-		 * Calculation:
-		 * c_fifo_delay_ps = (fifo_size * 32) / parallel_bus_width *
-		 *                   pclk_period_ps + 4 * csi_hsclk_period_ps
-		 */
-		c_fifo_delay_ps = _fifo_size * 32 * pclk_period_ps;
-		c_fifo_delay_ps /= format->bus_width;
-		c_fifo_delay_ps += 4 * csi_hsclk_period_ps;
-
-		/*
-		 * Calculation:
-		 * c_hactive_ps = csi_bps_period_ps * image_bpp * h_active_pixel
-		 *                + c_fifo_delay
-		 */
-		c_hactive_ps = csi_bps_period_ps * format->bpp * input->width;
-		c_hactive_ps += c_fifo_delay_ps;
-
-		/*
-		 * Calculation:
-		 * c_lp_active_ps = p_htotal_ps - c_hactive_ps
-		 */
-		c_lp_active_ps = p_htotal_ps - c_hactive_ps;
-
-		c_hactive_ps_diff = c_hactive_ps - p_hactive_ps;
-		c_fifo_delay_ps_diff = p_htotal_ps - c_hactive_ps;
-		c_lp_active_ps_diff =
-		    c_lp_active_ps - csi_settings->csi_hs_lp_hs_ps;
-
-		if (c_hactive_ps_diff > 0 &&
-		    c_fifo_delay_ps_diff > 0 && c_lp_active_ps_diff > 0)
-			break;
-	}
+	if (tc358746_add_overflow(t->c_data_fs, c_fifo_delay_fs, c_hactive_fs))
+		return -EOVERFLOW;
+
+	return 0;
+}
+
+static bool tc358746_fifo_size_fits(const struct tc358746_line_timing *t,
+				    unsigned int fifo_size)
+{
+	u64 c_hactive_fs, c_lp_active_fs;
+
+	if (tc358746_get_c_hactive(t, fifo_size, &c_hactive_fs) < 0)
+		return false;
+
+	/* c_hactive_ps_diff > 0 and c_fifo_delay_ps_diff > 0 */
+	if (c_hactive_fs <= t->p_hactive_fs || c_hactive_fs >= t->p_htotal_fs)
+		return false;
+
+	/*
+	 * Calculation:
+	 * c_lp_active = p_htotal - c_hactive
+	 */
+	c_lp_active_fs = t->p_htotal_fs - c_hactive_fs;
+
+	/* c_lp_active_ps_diff > 0 */
+	return c_lp_active_fs > t->c_hs_lp_hs_fs;
+}
+
+/*
+ * Smallest fifo size for which the csi line is longer than the parallel one,
+ * TC358746_MAX_FIFO_SIZE if there is none. Doesn't depend on the hblank.
+ */
+static unsigned int tc358746_min_fifo_size(const struct tc358746_line_timing *t)
+{
+	u64 c_min_delay_fs, bits;
+
+	/*
+	 * The fifo delay only grows with the fifo size, so c_hactive_ps_diff is
+	 * the only inequality a larger fifo helps. The others only get worse,
+	 * thus the smallest fifo size which makes the csi line longer than the
+	 * parallel one is the only candidate.
+	 *
+	 * Calculation:
+	 * (fifo_size * 32 * pclk_period) / parallel_bus_width >
+	 *	p_hactive - c_data - 4 * csi_hsclk_period
+	 */
+	if (tc358746_add_overflow(t->c_data_fs, t->c_start_fs, &c_min_delay_fs))
+		return TC358746_MAX_FIFO_SIZE;
+
+	if (c_min_delay_fs > t->p_hactive_fs)
+		return 1;
+
+	/* the fifo delay is the time the parallel bus takes for the bits */
+	bits = tc358746_cycles_above(t->p_hactive_fs - c_min_delay_fs,
+				     t->pclk_bits);
+
+	return min_t(u64, TC358746_MAX_FIFO_SIZE, DIV_ROUND_UP(bits, 32));
+}
+
+/* the line timing failed, err is from tc358746_get_line_timing() */
+static int tc358746_line_timing_diag(const struct tc358746_input *input,
+				     int err, struct tc358746_diag *diag)
+{
+	if (err == -EOVERFLOW)
+		return tc358746_fail(diag, TC358746_REASON_OVERFLOW, 0, 0);
+
+	return tc358746_fail(diag, TC358746_REASON_PCLK, input->pclk, 1000);
+}
+
+/*
+ * No fifo size fits. Either even the largest one doesn't delay the csi line
+ * enough, or the line is too short for the csi line and the hs->lp->hs
+ * transition, the bound is the shortest line then.
+ */
+static int tc358746_fifo_diag(const struct tc358746_line_timing *t,
+			      struct tc358746_diag *diag)
+{
+	unsigned int fifo_size = tc358746_min_fifo_size(t);
+	u64 c_hactive_fs;
+
+	if (fifo_size >= TC358746_MAX_FIFO_SIZE ||
+	    tc358746_get_c_hactive(t, fifo_size, &c_hactive_fs) < 0)
+		return tc358746_fail(diag, TC358746_REASON_FIFO_DEPTH,
+				     TC358746_MAX_FIFO_SIZE,
+				     TC358746_MAX_FIFO_SIZE - 1);
+
+	return tc358746_fail(diag, TC358746_REASON_LINE, t->p_htotal_fs / 1000,
+			     (c_hactive_fs + t->c_hs_lp_hs_fs) / 1000 + 1);
+}
+
+static int tc358746_adjust_fifo_size(const struct tc358746_input *input,
+				     const struct tc358746_mbus_fmt *format,
+				     struct tc358746_csi *csi_settings,
+				     u16 *fifo_size,
+				     struct tc358746_diag *diag)
+{
+	struct tc358746_line_timing t;
+	unsigned int _fifo_size;
+	int err;
+
+	err = tc358746_get_line_timing(input, format, csi_settings, &t);
+	if (err < 0)
+		return tc358746_line_timing_diag(input, err, diag);
+
+	_fifo_size = tc358746_min_fifo_size(&t);
+	if (_fifo_size >= TC358746_MAX_FIFO_SIZE ||
+	    !tc358746_fifo_size_fits(&t, _fifo_size))
+		_fifo_size = TC358746_MAX_FIFO_SIZE;
 
 	/*
 	 * If we can't transfer the image using this csi link frequency try to
@@ -182,47 +414,182 @@ static int tc358746_adjust_fifo_size(const struct tc358746_input *input,
 	log_info("found fifo-size %d\n",
 		 _fifo_size == TC358746_MAX_FIFO_SIZE ? -1 : _fifo_size);
 	*fifo_size = _fifo_size;
-	return _fifo_size == TC358746_MAX_FIFO_SIZE ? -EINVAL : 0;
+	if (_fifo_size == TC358746_MAX_FIFO_SIZE)
+		return tc358746_fifo_diag(&t, diag);
+
+	return 0;
+}
+
+#ifdef TC358746_FIFO_REFERENCE
+/*
+ * Reference implementation of tc358746_adjust_fifo_size(), tries every fifo
+ * size. Used by the host tools to verify the direct calculation.
+ */
+static int tc358746_adjust_fifo_size_ref(const struct tc358746_input *input,
+					 const struct tc358746_mbus_fmt *format,
+					 struct tc358746_csi *csi_settings,
+					 u16 *fifo_size,
+					 struct tc358746_diag *diag)
+{
+	struct tc358746_line_timing t;
+	unsigned int _fifo_size;
+	int err;
+
+	err = tc358746_get_line_timing(input, format, csi_settings, &t);
+	if (err < 0)
+		return tc358746_line_timing_diag(input, err, diag);
+
+	/*
+	 * Adjust the fifo size to adjust the csi timing. Hopefully we can find
+	 * a fifo size where the parallel input timings and the csi tx timings
+	 * fit together.
+	 */
+	for (_fifo_size = 1; _fifo_size < TC358746_MAX_FIFO_SIZE; _fifo_size++)
+		if (tc358746_fifo_size_fits(&t, _fifo_size))
+			break;
+
+	*fifo_size = _fifo_size;
+	if (_fifo_size == TC358746_MAX_FIFO_SIZE)
+		return tc358746_fifo_diag(&t, diag);
+
+	return 0;
 }
+#endif
+
+/* D-PHY state durations as programmed by the counts of a tc358746_csi */
+struct tc358746_dphy_timing {
+	u64 hsclk;		/* Hz */
+	u64 spl;		/* bps */
+	u64 lineinit_fs;
+	u64 lptxtime_fs;
+	u64 twakeup_fs;
+	u64 tclk_prepare_fs;
+	u64 tclk_zero_fs;
+	u64 tclk_trail_fs;
+	u64 tclk_post_fs;
+	u64 ths_prepare_fs;
+	u64 ths_zero_fs;
+	u64 ths_trail_fs;
+};
 
-static int tc358746_calculate_csi_txtimings(struct tc358746_csi *csi)
+/*
+ * The inverse of the count calculations in
+ * tc358746_calculate_csi_txtimings(), see there for the equations. Note the
+ * driver drops the last 'multiply all by two' of REF_02 to get nearly the
+ * same results.
+ */
+static void tc358746_get_dphy_timing(const struct tc358746_csi *csi,
+				     struct tc358746_dphy_timing *d)
 {
-	unsigned int spl;
-	unsigned int spl_p_ps, hsclk_p_ps, hfclk_p_ns;
-	unsigned int hfclk, hsclk;	/* SYSCLK */
-	unsigned int tmp;
-	unsigned int lptxtime_ps, tclk_post_ps, tclk_trail_ps, tclk_zero_ps,
-	    ths_trail_ps, ths_zero_ps;
+	u64 hsclk = csi->speed_per_lane >> 3;
+	u64 spl = csi->speed_per_lane;
+
+	d->hsclk = hsclk;
+	d->spl = spl;
+
+	d->lineinit_fs = tc358746_fs(csi->lineinitcnt, hsclk >> 1);
+	d->lptxtime_fs = tc358746_fs(csi->lptxtimecnt + 1, hsclk);
+	d->twakeup_fs = tc358746_fs((u64)(csi->lptxtimecnt + 1) *
+				    (csi->twakeupcnt + 1), hsclk);
+	d->tclk_prepare_fs = tc358746_fs(csi->tclk_preparecnt + 1, hsclk);
+	d->tclk_zero_fs = tc358746_fs(2 + csi->tclk_zerocnt, hsclk) +
+			  tc358746_fs(3, spl);
+	d->tclk_trail_fs = tc358746_fs(5 + csi->tclk_trailcnt, hsclk) -
+			   tc358746_fs(3, spl);
+	d->tclk_post_fs = tc358746_fs(4 + csi->tclk_postcnt, hsclk) +
+			  tc358746_fs(3, spl);
+	d->ths_prepare_fs = tc358746_fs(csi->ths_preparecnt + 1, hsclk);
+	d->ths_zero_fs = tc358746_fs(7 + csi->ths_zerocnt + 4, hsclk) +
+			 tc358746_fs(11, spl);
+	d->ths_trail_fs = tc358746_fs(5 + csi->ths_trailcnt, hsclk) -
+			  tc358746_fs(11, spl);
+}
+
+/*
+ * Exact hs->lp->hs transition: the line end and line start states as the
+ * counters program them, following the D-PHY state sequence.
+ *
+ * Data lane: the long packet header and footer, HS trail, LP-11 for at least
+ * THS-EXIT, LP-01 (TLPX), LP-00 (THS-PREPARE), HS-0 (THS-ZERO) and the sync
+ * byte. LP states last whole LPTX periods.
+ *
+ * With a discontinuous clock the clock lane follows the data lane into LP:
+ * TCLK-POST and TCLK-TRAIL after the data trail, and TLPX, TCLK-PREPARE,
+ * TCLK-ZERO and TCLK-PRE (8 UI) before the data lane's TLPX.
+ */
+static u64 tc358746_hs_lp_hs_exact(const struct tc358746_input *input,
+				   const struct tc358746_csi *csi,
+				   const struct tc358746_dphy_timing *d)
+{
+	u64 ths_exit_fs, packet_fs, tmp;
+
+	ths_exit_fs = DIV_ROUND_UP(TC358746_THSEXIT_MIN_NS * TC358746_FS_PER_NS,
+				   d->lptxtime_fs) * d->lptxtime_fs;
+	/* 4 byte packet header and 2 byte footer, spread over the lanes */
+	packet_fs = tc358746_fs(DIV_ROUND_UP(6, csi->lane_num), d->hsclk);
+
+	tmp = packet_fs + d->ths_trail_fs + ths_exit_fs + d->lptxtime_fs +
+	      d->ths_prepare_fs + d->ths_zero_fs + tc358746_fs(1, d->hsclk);
+
+	if (!csi->is_continuous_clk)
+		tmp += d->tclk_post_fs + d->tclk_trail_fs + d->lptxtime_fs +
+		       d->tclk_prepare_fs + d->tclk_zero_fs +
+		       tc358746_fs(1, d->hsclk);
+
+	tmp = DIV_ROUND_UP(tmp, 1000);
+
+	return tmp + DIV_ROUND_UP(tmp * input->hs_lp_hs_margin, 100);
+}
+
+/* the fewest hs byte clock cycles lasting at least @fs */
+static u64 tc358746_hsclk_cycles(u64 fs, u64 hsclk)
+{
+	/* fs is a D-PHY state below 1 us, the product can't overflow */
+	return DIV_ROUND_UP(fs * hsclk, TC358746_FS_PER_S);
+}
+
+static int tc358746_calculate_csi_txtimings(const struct tc358746_input *input,
+					    struct tc358746_csi *csi,
+					    struct tc358746_diag *diag)
+{
+	u64 spl;
+	u64 hfclk, hsclk;	/* SYSCLK */
+	u64 tmp;
+	struct tc358746_dphy_timing d;
 
 	spl = csi->speed_per_lane;
 	hsclk = spl >> 3;  /* spl in bit-per-second, hsclk in byte-per-sercond */
 	hfclk = hsclk >> 1;/* HFCLK = SYSCLK / 2 */
 
-	if (hsclk > 125000000U) {
-		log_error("unsupported HS byte clock %d, must <= 125 MHz\n", hsclk);
-		return -EINVAL;
+	if (hsclk > TC358746_HSBYTECLK_MAX) {
+		log_error("unsupported HS byte clock %llu, must <= 125 MHz\n",
+			  (unsigned long long)hsclk);
+		return tc358746_fail(diag, TC358746_REASON_HSBYTECLK, hsclk,
+				     TC358746_HSBYTECLK_MAX);
 	}
 
-	hfclk_p_ns = DIV_ROUND_CLOSEST(1000000000, hfclk);
-	hsclk_p_ps = 1000000000 / (hsclk / 1000);
-	spl_p_ps = 1000000000 / (spl / 1000);
+	/*
+	 * The periods are exact, hsclk_p = 1 / hsclk and spl_p = 1 / spl, the
+	 * terms in spl_p are calculated in fs, see tc358746_fs().
+	 */
 
 	/*
 	 * Calculation:
-	 * hfclk_p_ns * lineinitcnt > 100us
-	 * lineinitcnt > 100 * 10^-6s / hfclk_p_ns * 10^-9
+	 * hfclk_p * lineinitcnt > 100us
+	 * lineinitcnt > 100 * 10^-6s * hfclk
 	 *
 	 */
-	csi->lineinitcnt = DIV_ROUND_UP(TC358746_LINEINIT_MIN_US * 1000,
-						hfclk_p_ns);
+	csi->lineinitcnt = DIV_ROUND_UP(TC358746_LINEINIT_MIN_US * hfclk,
+					1000000);
 
 	/*
 	 * Calculation:
-	 * (lptxtimecnt + 1) * hsclk_p_ps > 50ns
-	 * 38ns < (tclk_preparecnt + 1) * hsclk_p_ps < 95ns
+	 * (lptxtimecnt + 1) * hsclk_p > 50ns
+	 * 38ns < (tclk_preparecnt + 1) * hsclk_p < 95ns
 	 */
 	csi->lptxtimecnt = csi->tclk_preparecnt =
-	    DIV_ROUND_UP(TC358746_LPTXTIME_MIN_NS * 1000, hsclk_p_ps) - 1;
+	    tc358746_hsclk_cycles(TC358746_LPTXTIME_MIN_NS * TC358746_FS_PER_NS,
+				  hsclk) - 1;
 
 	/*
 	 * Limit:
@@ -231,154 +598,323 @@ static int tc358746_calculate_csi_txtimings(struct tc358746_csi *csi)
 	 * tclk_zero > 300ns.
 	 *
 	 * Calculation:
-	 * tclk_zero = ([2,3] + tclk_zerocnt) * hsclk_p_ps + ([2,3] * spl_p_ps)
+	 * tclk_zero = ([2,3] + tclk_zerocnt) * hsclk_p + ([2,3] * spl_p)
 	 *
 	 * Note: REF_02 uses
-	 * tclk_zero = (2.5 + tclk_zerocnt) * hsclk_p_ps + (3.5 * spl_p_ps)
+	 * tclk_zero = (2.5 + tclk_zerocnt) * hsclk_p + (3.5 * spl_p)
 	 */
-	tmp = TC358746_TCLKZERO_MIN_NS * 1000 - 3 * spl_p_ps;
-	tmp = DIV_ROUND_UP(tmp, hsclk_p_ps);
+	tmp = TC358746_TCLKZERO_MIN_NS * TC358746_FS_PER_NS - tc358746_fs(3, spl);
+	tmp = tc358746_hsclk_cycles(tmp, hsclk);
 	csi->tclk_zerocnt = tmp - 2;
 
 	/*
 	 * Limit:
-	 * 40ns + 4 * spl_p_ps < (ths_preparecnt + 1) * hsclk_p_ps
-	 *                     < 85ns + 6 * spl_p_ps
+	 * 40ns + 4 * spl_p < (ths_preparecnt + 1) * hsclk_p
+	 *                  < 85ns + 6 * spl_p
 	 */
-	tmp = TC358746_THSPREPARE_MIN_NS * 1000 + 4 * spl_p_ps;
-	tmp = DIV_ROUND_UP(tmp, hsclk_p_ps);
+	tmp = TC358746_THSPREPARE_MIN_NS * TC358746_FS_PER_NS +
+	      tc358746_fs(4, spl);
+	tmp = tc358746_hsclk_cycles(tmp, hsclk);
 	csi->ths_preparecnt = tmp - 1;
 
 	/*
 	 * Limit:
-	 * (ths_zero + ths_prepare) period > 145ns + 10 * spl_p_ps.
+	 * (ths_zero + ths_prepare) period > 145ns + 10 * spl_p.
 	 * Since we have no upper limit and for simplicity:
-	 * ths_zero period > 145ns + 10 * spl_p_ps.
+	 * ths_zero period > 145ns + 10 * spl_p.
 	 *
 	 * Calculation:
-	 * ths_zero = ([6,8] + ths_zerocnt) * hsclk_p_ps + [3,4] * hsclk_p_ps +
-	 *            [13,14] * spl_p_ps
+	 * ths_zero = ([6,8] + ths_zerocnt) * hsclk_p + [3,4] * hsclk_p +
+	 *            [13,14] * spl_p
 	 *
 	 * Note: REF_02 uses
-	 * ths_zero = (7 + ths_zerocnt) * hsclk_p_ps + 4 * hsclk_p_ps +
-	 *            11 * spl_p_ps
+	 * ths_zero = (7 + ths_zerocnt) * hsclk_p + 4 * hsclk_p +
+	 *            11 * spl_p
 	 */
-	tmp = TC358746_THSZERO_MIN_NS * 1000 - spl_p_ps;
-	tmp = DIV_ROUND_UP(tmp, hsclk_p_ps);
+	tmp = TC358746_THSZERO_MIN_NS * TC358746_FS_PER_NS - tc358746_fs(1, spl);
+	tmp = tc358746_hsclk_cycles(tmp, hsclk);
 	csi->ths_zerocnt = tmp < 11 ? 0 : tmp - 11;
 
 	/*
 	 * Limit:
-	 * hsclk_p_ps * (lptxtimecnt + 1) * (twakeupcnt + 1) > 1ms
+	 * hsclk_p * (lptxtimecnt + 1) * (twakeupcnt + 1) > 1ms
 	 *
 	 * Since we have no upper limit use 1.2ms as lower limit to
 	 * surley meet the spec limit.
 	 */
-	tmp = hsclk_p_ps / 1000;	/* tmp = hsclk_p_ns */
 	csi->twakeupcnt =
-	    DIV_ROUND_UP(TC358746_TWAKEUP_MIN_US * 1000,
-			 tmp * (csi->lptxtimecnt + 1)) - 1;
+	    DIV_ROUND_UP(TC358746_TWAKEUP_MIN_US * hsclk,
+			 1000000ULL * (csi->lptxtimecnt + 1)) - 1;
 
 	/*
 	 * Limit:
-	 * 60ns + 4 * spl_p_ps < thstrail < 105ns + 12 * spl_p_ps
+	 * 60ns + 4 * spl_p < thstrail < 105ns + 12 * spl_p
 	 *
 	 * Calculation:
-	 * thstrail = (1 + ths_trailcnt) * hsclk_p_ps + [3,4] * hsclk_p_ps -
-	 *            [13,14] * spl_p_ps
+	 * thstrail = (1 + ths_trailcnt) * hsclk_p + [3,4] * hsclk_p -
+	 *            [13,14] * spl_p
 	 *
 	 * [2] set formula to:
-	 * thstrail = (1 + ths_trailcnt) * hsclk_p_ps + 4 * hsclk_p_ps -
-	 *            11 * spl_p_ps
+	 * thstrail = (1 + ths_trailcnt) * hsclk_p + 4 * hsclk_p -
+	 *            11 * spl_p
 	 */
-	tmp = TC358746_THSTRAIL_MIN_NS * 1000 + 15 * spl_p_ps;
-	tmp = DIV_ROUND_UP(tmp, hsclk_p_ps);
-	csi->ths_trailcnt = tmp - 5;
+	tmp = TC358746_THSTRAIL_MIN_NS * TC358746_FS_PER_NS +
+	      tc358746_fs(15, spl);
+	tmp = tc358746_hsclk_cycles(tmp, hsclk);
+	csi->ths_trailcnt = tmp < 5 ? 0 : tmp - 5;
 
 	/*
 	 * Limit:
-	 * 60ns < tclk_trail < 105ns + 12 * spl_p_ps
+	 * 60ns < tclk_trail < 105ns + 12 * spl_p
 	 *
 	 * Limit used by REF_02:
-	 * 60ns < tclk_trail < 105ns + 12 * spl_p_ps - 30
+	 * 60ns < tclk_trail < 105ns + 12 * spl_p - 30
 	 *
 	 * Calculation:
-	 * tclk_trail = ([1,2] + tclk_trailcnt) * hsclk_p_ps +
-	 *              (2 + [1,2]) * hsclk_p_ps - [2,3] * spl_p_ps
+	 * tclk_trail = ([1,2] + tclk_trailcnt) * hsclk_p +
+	 *              (2 + [1,2]) * hsclk_p - [2,3] * spl_p
 	 *
 	 * Calculation used by REF_02:
-	 * tclk_trail = (1 + tclk_trailcnt) * hsclk_p_ps +
-	 *              4 * hsclk_p_ps - 3 * spl_p_ps
+	 * tclk_trail = (1 + tclk_trailcnt) * hsclk_p +
+	 *              4 * hsclk_p - 3 * spl_p
 	 */
-	tmp = TC358746_TCLKTRAIL_MIN_NS * 1000 + 3 * spl_p_ps;
-	tmp = DIV_ROUND_UP(tmp, hsclk_p_ps);
+	tmp = TC358746_TCLKTRAIL_MIN_NS * TC358746_FS_PER_NS +
+	      tc358746_fs(3, spl);
+	tmp = tc358746_hsclk_cycles(tmp, hsclk);
 	csi->tclk_trailcnt = tmp < 5 ? 0 : tmp - 5;
 
 	/*
 	 * Limit:
-	 * tclk_post > 60ns + 52 * spl_p_ps
+	 * tclk_post > 60ns + 52 * spl_p
 	 *
 	 * Limit used by REF_02:
-	 * tclk_post > 60ns + 52 * spl_p_ps
+	 * tclk_post > 60ns + 52 * spl_p
 	 *
 	 * Calculation:
-	 * tclk_post = ([1,2] + (tclk_postcnt + 1)) * hsclk_p_ps + hsclk_p_ps
+	 * tclk_post = ([1,2] + (tclk_postcnt + 1)) * hsclk_p + hsclk_p
 	 *
 	 * Note REF_02 uses:
-	 * tclk_post = (2.5 + tclk_postcnt) * hsclk_p_ps + hsclk_p_ps +
-	 *              2.5 * spl_p_ps
+	 * tclk_post = (2.5 + tclk_postcnt) * hsclk_p + hsclk_p +
+	 *              2.5 * spl_p
 	 * To meet the REF_02 validation limits following equation is used:
-	 * tclk_post = (2 + tclk_postcnt) * hsclk_p_ps + hsclk_p_ps +
-	 *              3 * spl_p_ps
+	 * tclk_post = (2 + tclk_postcnt) * hsclk_p + hsclk_p +
+	 *              3 * spl_p
 	 */
-	tmp = TC358746_TCLKPOST_MIN_NS * 1000 + 49 * spl_p_ps;
-	tmp = DIV_ROUND_UP(tmp, hsclk_p_ps);
+	tmp = TC358746_TCLKPOST_MIN_NS * TC358746_FS_PER_NS +
+	      tc358746_fs(49, spl);
+	tmp = tc358746_hsclk_cycles(tmp, hsclk);
 	csi->tclk_postcnt = tmp - 3;
 
 	/*
 	 * Last calculate the csi hs->lp->hs transistion time in ns. Note REF_02
 	 * mixed units in the equation for the continuous case. I don't know if
-	 * this was the intention. The driver drops the last 'multiply all by
-	 * two' to get nearly the same results.
+	 * this was the intention.
 	 */
-	lptxtime_ps = (csi->lptxtimecnt + 1) * hsclk_p_ps;
-	tclk_post_ps =
-	    (4 + csi->tclk_postcnt) * hsclk_p_ps + 3 * spl_p_ps;
-	tclk_trail_ps =
-	    (5 + csi->tclk_trailcnt) * hsclk_p_ps - 3 * spl_p_ps;
-	tclk_zero_ps =
-	    (2 + csi->tclk_zerocnt) * hsclk_p_ps + 3 * spl_p_ps;
-	ths_trail_ps =
-	    (5 + csi->ths_trailcnt) * hsclk_p_ps - 11 * spl_p_ps;
-	ths_zero_ps =
-	    (7 + csi->ths_zerocnt) * hsclk_p_ps + 4 * hsclk_p_ps +
-	    11 * spl_p_ps;
+	tc358746_get_dphy_timing(csi, &d);
+
+	if (input->hs_lp_hs_model == TC358746_HS_LP_HS_EXACT) {
+		csi->csi_hs_lp_hs_ps = tc358746_hs_lp_hs_exact(input, csi, &d);
+		return 0;
+	}
 
 	if (csi->is_continuous_clk) {
-		tmp = 2 * lptxtime_ps;
-		tmp += 25 * hsclk_p_ps;
-		tmp += ths_trail_ps;
-		tmp += ths_zero_ps;
+		tmp = 2 * d.lptxtime_fs;
+		tmp += tc358746_fs(25, hsclk);
+		tmp += d.ths_trail_fs;
+		tmp += d.ths_zero_fs;
 	} else {
-		tmp = 4 * lptxtime_ps;
-		tmp += ths_trail_ps + tclk_post_ps + tclk_trail_ps +
-		    tclk_zero_ps + ths_zero_ps;
-		tmp += (13 + csi->lptxtimecnt * 8) * hsclk_p_ps;
-		tmp += 22 * hsclk_p_ps;
+		tmp = 4 * d.lptxtime_fs;
+		tmp += d.ths_trail_fs + d.tclk_post_fs + d.tclk_trail_fs +
+		    d.tclk_zero_fs + d.ths_zero_fs;
+		tmp += tc358746_fs(13 + csi->lptxtimecnt * 8, hsclk);
+		tmp += tc358746_fs(22, hsclk);
 		tmp *= 3;
 		tmp = DIV_ROUND_CLOSEST(tmp, 2);
 	}
-	csi->csi_hs_lp_hs_ps = tmp;
+	csi->csi_hs_lp_hs_ps = DIV_ROUND_UP(tmp, 1000);
 
 	return 0;
 }
 
-static int tc358746_set_lane_settings(const struct tc358746_input *input,
-				      const struct tc358746_pll *pll,
-				      struct tc358746_csi *csi)
+/* a legal pll setting, its lane rate is num / den */
+struct tc358746_pll_rate {
+	u64 num;
+	u64 den;
+	u32 prd;
+	u32 fbd;
+	u32 frs;
+};
+
+/*
+ * The lane rate is refclk * fbd / (prd * 2^frs). The register fields hold
+ * pll_prd - 1 and pll_fbd - 1, frs is the speed range.
+ *
+ * Of all legal settings pick the one with the lowest lane rate at or above
+ * @bps. Within a pre-divider and frs the best feedback divider is the
+ * smallest one reaching @bps, so it is computed instead of walking all of
+ * them. On a tie the lower PLL input clock wins.
+ */
+static bool tc358746_pll_rate(u64 refclk, u64 bps,
+			      struct tc358746_pll_rate *best)
 {
-	struct tc358746_csi *s = csi;
-	u32 bps_pr_lane;
+	u32 prd, frs;
+
+	best->prd = 0;
+
+	for (prd = 1; prd <= TC358746_PLL_PRD_MAX; prd++) {
+		/* the PLL input clock must be between 4 MHz and 40 MHz */
+		if (refclk < prd * TC358746_PLLINCLK_MIN ||
+		    refclk > prd * TC358746_PLLINCLK_MAX)
+			continue;
+
+		for (frs = 0; frs <= TC358746_PLL_FRS_MAX; frs++) {
+			u64 den = (u64)prd << frs;
+			u64 fbd = DIV_ROUND_UP(bps * den, refclk);
+			u64 num = refclk * fbd;
+
+			if (fbd > TC358746_PLL_FBD_MAX)
+				continue;
+
+			/* the VCO must run between 500 MHz and 1 GHz */
+			if (num < TC358746_VCO_MIN * prd ||
+			    num > TC358746_VCO_MAX * prd)
+				continue;
+
+			if (best->prd && num * best->den > best->num * den)
+				continue;
+			if (best->prd && num * best->den == best->num * den &&
+			    prd <= best->prd)
+				continue;
+
+			best->num = num;
+			best->den = den;
+			best->prd = prd;
+			best->fbd = fbd;
+			best->frs = frs;
+		}
+	}
+
+	return best->prd && best->num <= TC358746_LANE_RATE_MAX * best->den;
+}
+
+/* the feedback dividers of one pre-divider and frs left to walk */
+struct tc358746_pll_window {
+	u16 fbd;
+	u16 fbd_max;
+	u8 prd;
+	u8 frs;
+};
+
+/*
+ * Cut the legal settings of tc358746_pll_rate() down to the feedback
+ * dividers with a lane rate in [@lo, @hi] bps, one window per pre-divider and
+ * frs, and return the number of windows. The VCO range bounds the feedback
+ * divider of a pre-divider, the lane rate bounds it once frs is known, so
+ * most pairs are left with a few dividers or none. @prev is set to the
+ * highest legal lane rate below @lo, 0 if there is none.
+ */
+static unsigned int tc358746_pll_windows(u64 refclk, u64 lo, u64 hi,
+					 struct tc358746_pll_window *win,
+					 struct tc358746_pll_rate *prev)
+{
+	unsigned int num = 0;
+	u32 prd, frs;
+
+	prev->num = 0;
+	prev->den = 1;
+
+	for (prd = 1; prd <= TC358746_PLL_PRD_MAX; prd++) {
+		u64 vco_lo, vco_hi;
+
+		if (refclk < prd * TC358746_PLLINCLK_MIN ||
+		    refclk > prd * TC358746_PLLINCLK_MAX)
+			continue;
+
+		vco_lo = DIV_ROUND_UP(TC358746_VCO_MIN * prd, refclk);
+		vco_hi = min_t(u64, TC358746_VCO_MAX * prd / refclk,
+			       TC358746_PLL_FBD_MAX);
+
+		for (frs = 0; frs <= TC358746_PLL_FRS_MAX; frs++) {
+			u64 den = (u64)prd << frs;
+			u64 fbd_lo = DIV_ROUND_UP(lo * den, refclk);
+			u64 fbd_hi = min(vco_hi, hi * den / refclk);
+			u64 below;
+
+			/* the highest divider below the window */
+			below = min(fbd_lo - 1, vco_hi);
+			if (fbd_lo > vco_lo && below >= vco_lo &&
+			    refclk * below * prev->den > prev->num * den) {
+				prev->num = refclk * below;
+				prev->den = den;
+			}
+
+			fbd_lo = max(fbd_lo, vco_lo);
+			if (fbd_lo > fbd_hi)
+				continue;
+
+			win[num].fbd = fbd_lo;
+			win[num].fbd_max = fbd_hi;
+			win[num].prd = prd;
+			win[num].frs = frs;
+			num++;
+		}
+	}
+
+	return num;
+}
+
+/*
+ * Set @rate to the lowest lane rate left in the @num windows and step every
+ * window past it. Returns false once all windows are walked.
+ */
+static bool tc358746_pll_windows_next(u64 refclk,
+				      struct tc358746_pll_window *win,
+				      unsigned int num,
+				      struct tc358746_pll_rate *rate)
+{
+	unsigned int i;
+
+	rate->den = 0;
+
+	for (i = 0; i < num; i++) {
+		u64 n = refclk * win[i].fbd;
+		u64 d = (u64)win[i].prd << win[i].frs;
+
+		if (win[i].fbd > win[i].fbd_max)
+			continue;
+		if (!rate->den || n * rate->den < rate->num * d) {
+			rate->num = n;
+			rate->den = d;
+		}
+	}
+
+	if (!rate->den)
+		return false;
+
+	for (i = 0; i < num; i++)
+		if (win[i].fbd <= win[i].fbd_max &&
+		    refclk * win[i].fbd * rate->den ==
+		    rate->num * ((u64)win[i].prd << win[i].frs))
+			win[i].fbd++;
+
+	return true;
+}
+
+/* the timings are calculated with the lane rate actually achieved */
+static int tc358746_setup_pll(const struct tc358746_input *input,
+			      struct tc358746_pll *pll,
+			      struct tc358746_csi *csi,
+			      struct tc358746_diag *diag)
+{
+	struct tc358746_pll_rate best;
+	u64 bps_pr_lane;
+
+	if (input->refclk < 6000000 || input->refclk > 40000000) {
+		log_error("refclk must between 6MHz and 40MHz\n");
+		return tc358746_fail(diag, TC358746_REASON_REFCLK,
+				     input->refclk,
+				     input->refclk < 6000000 ? 6000000 : 40000000);
+	}
 
 	/*
 	 * The CSI bps per lane must be between 62.5 Mbps and 1 Gbps.
@@ -386,23 +922,56 @@ static int tc358746_set_lane_settings(const struct tc358746_input *input,
 	 * data rate.
 	 */
 	bps_pr_lane = 2 * input->link_frequency;
-	if (bps_pr_lane < 62500000U || bps_pr_lane > 1000000000U) {
-		log_error("unsupported bps per lane: %u bps\n", bps_pr_lane);
-		return -EINVAL;
+	if (bps_pr_lane < TC358746_LANE_RATE_MIN) {
+		log_error("unsupported bps per lane: %llu bps\n",
+			  (unsigned long long)bps_pr_lane);
+		return tc358746_fail(diag, TC358746_REASON_LANE_RATE_LOW,
+				     bps_pr_lane, TC358746_LANE_RATE_MIN);
+	}
+	if (bps_pr_lane > TC358746_LANE_RATE_MAX) {
+		log_error("unsupported bps per lane: %llu bps\n",
+			  (unsigned long long)bps_pr_lane);
+		return tc358746_fail(diag, TC358746_REASON_LANE_RATE_HIGH,
+				     bps_pr_lane, TC358746_LANE_RATE_MAX);
+	}
+
+	if (!tc358746_pll_rate(input->refclk, bps_pr_lane, &best)) {
+		log_error("no pll setting for %llu bps per lane\n",
+			  (unsigned long long)bps_pr_lane);
+		return tc358746_fail(diag, TC358746_REASON_PLL, bps_pr_lane,
+				     TC358746_LANE_RATE_MAX);
 	}
 
-	if (bps_pr_lane > 500000000)
-		s->speed_range = 0;
-	else if (bps_pr_lane > 250000000)
-		s->speed_range = 1;
-	else if (bps_pr_lane > 125000000)
-		s->speed_range = 2;
-	else
-		s->speed_range = 3;
+	pll->pll_prd = best.prd;
+	pll->pll_fbd = best.fbd;
+	pll->pllinclk_hz = DIV_ROUND_CLOSEST(input->refclk, best.prd);
+
+	csi->speed_range = best.frs;
+	csi->speed_per_lane = best.num / best.den;
+
+	log_info("pll prd %u fbd %u frs %u: %u bps/lane requested %llu\n",
+		 best.prd, best.fbd, best.frs, csi->speed_per_lane,
+		 (unsigned long long)bps_pr_lane);
+
+	return 0;
+}
+
+static int tc358746_set_lane_settings(const struct tc358746_input *input,
+				      const struct tc358746_pll *pll,
+				      struct tc358746_csi *csi,
+				      struct tc358746_diag *diag)
+{
+	struct tc358746_csi *s = csi;
+
+	if (input->num_lanes < 1 || input->num_lanes > 4) {
+		log_error("unsupported number of lanes: %d\n", input->num_lanes);
+		return tc358746_fail(diag, TC358746_REASON_LANES,
+				     input->num_lanes,
+				     input->num_lanes < 1 ? 1 : 4);
+	}
 
 	s->unit_clk_hz = pll->pllinclk_hz >> s->speed_range;
-	s->unit_clk_mul = bps_pr_lane / s->unit_clk_hz;
-	s->speed_per_lane = bps_pr_lane;
+	s->unit_clk_mul = s->speed_per_lane / s->unit_clk_hz;
 	s->lane_num = input->num_lanes;
 	s->is_continuous_clk = !input->discontinuous_clk;
 
@@ -413,92 +982,864 @@ static int tc358746_set_lane_settings(const struct tc358746_input *input,
 	return 0;
 }
 
-static int tc358746_setup_pll(const struct tc358746_input *input,
-			      struct tc358746_pll *pll)
+/* the first stage whose input differs from the one cached in @ctx */
+static enum tc358746_stage tc358746_ctx_changed(const struct tc358746_ctx *ctx,
+						const struct tc358746_input *b)
 {
-	unsigned int pllinclk;
-	unsigned char pll_prediv;
+	const struct tc358746_input *a = &ctx->input;
 
-	if (input->refclk < 6000000 || input->refclk > 40000000) {
-		log_error("refclk must between 6MHz and 40MHz\n");
+	if (a->mbus_fmt != b->mbus_fmt || a->width != b->width)
+		return TC358746_STAGE_FORMAT;
+	if (a->refclk != b->refclk || a->link_frequency != b->link_frequency)
+		return TC358746_STAGE_PLL;
+	if (a->num_lanes != b->num_lanes ||
+	    a->discontinuous_clk != b->discontinuous_clk)
+		return TC358746_STAGE_LANES;
+	if (a->hs_lp_hs_model != b->hs_lp_hs_model ||
+	    a->hs_lp_hs_margin != b->hs_lp_hs_margin)
+		return TC358746_STAGE_TIMINGS;
+	if (a->pclk != b->pclk || a->hblank != b->hblank)
+		return TC358746_STAGE_FIFO;
+
+	return TC358746_STAGE_DONE;
+}
+
+/*
+ * Run the stages of @input up to and including @last, starting at the first
+ * one which isn't cached in @ctx. Every stage only writes its own results,
+ * so the ones of the earlier stages stay valid.
+ */
+static int tc358746_ctx_run(struct tc358746_ctx *ctx,
+			    const struct tc358746_input *input,
+			    enum tc358746_stage last,
+			    struct tc358746_diag *diag,
+			    bool reference __maybe_unused)
+{
+	enum tc358746_stage stage = min(ctx->done, tc358746_ctx_changed(ctx, input));
+	int err = 0;
+
+	ctx->input = *input;
+
+	for (; stage <= last && !err; stage++) {
+		/* until this stage succeeds only the earlier ones are valid */
+		ctx->done = stage;
+
+		switch (stage) {
+		case TC358746_STAGE_FORMAT:
+			ctx->format = tc358746_get_format(input->mbus_fmt);
+			if (!ctx->format) {
+				err = tc358746_fail(diag, TC358746_REASON_FORMAT,
+						    (u32)input->mbus_fmt, 0);
+				break;
+			}
+
+			/*
+			 * WORDCNT is in bytes, a packed RAW line has to end on
+			 * a byte boundary
+			 */
+			if (((u64)input->width * ctx->format->bpp) % 8) {
+				log_error("%u pixels of %u bpp is not a whole number of bytes\n",
+					  input->width, ctx->format->bpp);
+				err = tc358746_fail(diag, TC358746_REASON_WIDTH,
+						    (u64)input->width *
+						    ctx->format->bpp, 8);
+			}
+			break;
+		case TC358746_STAGE_PLL:
+			err = tc358746_setup_pll(input, &ctx->pll, &ctx->csi,
+						 diag);
+			break;
+		case TC358746_STAGE_LANES:
+			err = tc358746_set_lane_settings(input, &ctx->pll,
+							 &ctx->csi, diag);
+			break;
+		case TC358746_STAGE_TIMINGS:
+			err = tc358746_calculate_csi_txtimings(input, &ctx->csi,
+							       diag);
+			break;
+		case TC358746_STAGE_FIFO:
+#ifdef TC358746_FIFO_REFERENCE
+			if (reference)
+				err = tc358746_adjust_fifo_size_ref(input,
+					ctx->format, &ctx->csi, &ctx->vb_fifo,
+					diag);
+			else
+#endif
+				err = tc358746_adjust_fifo_size(input,
+					ctx->format, &ctx->csi, &ctx->vb_fifo,
+					diag);
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (err < 0)
 		return -EINVAL;
+
+	ctx->done = stage;
+
+	return 0;
+}
+
+/* forget every cached stage */
+void tc358746_ctx_init(struct tc358746_ctx *ctx)
+{
+	ctx->done = TC358746_STAGE_FORMAT;
+}
+
+/*
+ * Same as tc358746_calculate_diag(), but only the stages depending on the
+ * fields of @input which changed since the last call on @ctx are calculated
+ * again: the format on mbus_fmt and width, the PLL on refclk and
+ * link_frequency, the lane settings on num_lanes and discontinuous_clk, the
+ * timings on hs_lp_hs_*, the fifo on pclk and hblank, and every stage on
+ * the ones before it. @diag may be NULL.
+ */
+int tc358746_ctx_calculate(struct tc358746_ctx *ctx, struct tc358746 *self,
+			   const struct tc358746_input *input,
+			   struct tc358746_diag *diag)
+{
+	if (tc358746_ctx_run(ctx, input, TC358746_STAGE_FIFO, diag, false) < 0)
+		return -EINVAL;
+
+	if (diag)
+		diag->reason = TC358746_REASON_NONE;
+
+	self->format = ctx->format;
+	self->pll = ctx->pll;
+	self->csi = ctx->csi;
+	self->vb_fifo = ctx->vb_fifo;
+
+	return 0;
+}
+
+static int __tc358746_calculate(struct tc358746 *self,
+				const struct tc358746_input *input,
+				struct tc358746_diag *diag, bool reference)
+{
+	struct tc358746_ctx ctx;
+
+	tc358746_ctx_init(&ctx);
+	if (tc358746_ctx_run(&ctx, input, TC358746_STAGE_FIFO, diag,
+			     reference) < 0)
+		return -EINVAL;
+
+	if (diag)
+		diag->reason = TC358746_REASON_NONE;
+
+	self->format = ctx.format;
+	self->pll = ctx.pll;
+	self->csi = ctx.csi;
+	self->vb_fifo = ctx.vb_fifo;
+
+	return 0;
+}
+
+int tc358746_calculate(struct tc358746 *self,
+		       const struct tc358746_input *input)
+{
+	return __tc358746_calculate(self, input, NULL, false);
+}
+
+/*
+ * Same as tc358746_calculate(), on failure @diag tells which bound was
+ * violated, see enum tc358746_reason.
+ */
+int tc358746_calculate_diag(struct tc358746 *self,
+			    const struct tc358746_input *input,
+			    struct tc358746_diag *diag)
+{
+	return __tc358746_calculate(self, input, diag, false);
+}
+
+const char *tc358746_reason_str(enum tc358746_reason reason)
+{
+	switch (reason) {
+	case TC358746_REASON_NONE:
+		return "none";
+	case TC358746_REASON_FORMAT:
+		return "unsupported format";
+	case TC358746_REASON_WIDTH:
+		return "line not a whole number of bytes";
+	case TC358746_REASON_REFCLK:
+		return "refclk out of range";
+	case TC358746_REASON_LANE_RATE_LOW:
+		return "lane rate too low";
+	case TC358746_REASON_LANE_RATE_HIGH:
+		return "lane rate too high";
+	case TC358746_REASON_PLL:
+		return "no pll setting";
+	case TC358746_REASON_LANES:
+		return "unsupported number of lanes";
+	case TC358746_REASON_HSBYTECLK:
+		return "hs byte clock too high";
+	case TC358746_REASON_PCLK:
+		return "pclk too low";
+	case TC358746_REASON_OVERFLOW:
+		return "line timing overflow";
+	case TC358746_REASON_FIFO_DEPTH:
+		return "fifo too small";
+	case TC358746_REASON_LINE:
+		return "line too short";
+	case TC358746_REASON_FRAMERATE:
+		return "frame rate too high";
 	}
 
-	/*
-	 * The PLL input clock is obtained by dividing refclk by pll_prd.
-	 * It must be between 4 MHz and 40 MHz, lower frequency is better.
-	 */
-	pll_prediv = DIV_ROUND_CLOSEST(input->refclk, 4000000);
-	if (pll_prediv < 1 || pll_prediv > 16) {
-		log_error("invalid pll pre-divider value: %d\n", pll_prediv);
+	return "???";
+}
+
+/*
+ * The lane rate bounds, the HS byte clock and the fifo depth only get worse
+ * with a faster link, the PLL reaches a lane rate at or above the requested
+ * one. A too short line or frame usually gets better with a faster link, but
+ * the count quantisation makes that no rule, so nothing is pruned.
+ */
+enum tc358746_prune tc358746_diag_prune(const struct tc358746_diag *diag)
+{
+	switch (diag->reason) {
+	case TC358746_REASON_LANE_RATE_LOW:
+		return TC358746_PRUNE_BELOW;
+	case TC358746_REASON_LANE_RATE_HIGH:
+	case TC358746_REASON_PLL:
+	case TC358746_REASON_HSBYTECLK:
+	case TC358746_REASON_FIFO_DEPTH:
+		return TC358746_PRUNE_ABOVE;
+	case TC358746_REASON_NONE:
+	case TC358746_REASON_LINE:
+	case TC358746_REASON_FRAMERATE:
+		return TC358746_PRUNE_NONE;
+	default:
+		return TC358746_PRUNE_ALL;
+	}
+}
+
+#ifdef TC358746_FIFO_REFERENCE
+int tc358746_calculate_ref(struct tc358746 *self,
+			   const struct tc358746_input *input)
+{
+	return __tc358746_calculate(self, input, NULL, true);
+}
+#endif
+
+/* only the fields the register values depend on, the frame is left out */
+static bool tc358746_input_equal(const struct tc358746_input *a,
+				 const struct tc358746_input *b)
+{
+	return a->mbus_fmt == b->mbus_fmt &&
+	       a->refclk == b->refclk &&
+	       a->link_frequency == b->link_frequency &&
+	       a->num_lanes == b->num_lanes &&
+	       a->discontinuous_clk == b->discontinuous_clk &&
+	       a->hs_lp_hs_model == b->hs_lp_hs_model &&
+	       a->hs_lp_hs_margin == b->hs_lp_hs_margin &&
+	       a->pclk == b->pclk &&
+	       a->width == b->width &&
+	       a->hblank == b->hblank;
+}
+
+/*
+ * Look up the parameters of @input in a table generated by 'calc header'.
+ * Returns -ENOENT if the table doesn't cover @input, the caller should fall
+ * back to tc358746_calculate() then.
+ */
+int tc358746_lookup(struct tc358746 *self,
+		    const struct tc358746_input *input,
+		    const struct tc358746_table_entry *table,
+		    unsigned int table_size)
+{
+	const struct tc358746_mbus_fmt *format;
+	unsigned int i;
+
+	for (i = 0; i < table_size; i++) {
+		if (!tc358746_input_equal(&table[i].input, input))
+			continue;
+
+		format = tc358746_get_format(input->mbus_fmt);
+		if (!format)
+			return -EINVAL;
+
+		self->format = format;
+		self->pll = table[i].pll;
+		self->csi = table[i].csi;
+		self->vb_fifo = table[i].vb_fifo;
+
+		return 0;
+	}
+
+	return -ENOENT;
+}
+
+/*
+ * Frame timing of the configuration @self calculated for @input, which must
+ * have the height set.
+ *
+ * The frame rate follows from the parallel timing alone. The maximum frame
+ * rate is the one reached if the parallel side shortened its lines down to
+ * what the CSI side needs: the active line including the fifo delay, plus
+ * the HS-LP-HS transition.
+ */
+int tc358746_frame_timing(const struct tc358746 *self,
+			  const struct tc358746_input *input,
+			  struct tc358746_frame *frame)
+{
+	struct tc358746_line_timing t;
+	u64 lines, p_htotal, c_hactive_fs, c_line_fs, c_frame_fs;
+	u64 frame_fs, c_data_frame_fs;
+
+	if (!input->height) {
+		log_error("frame timing needs the height\n");
 		return -EINVAL;
 	}
-	pll->pll_prd = pll_prediv;
 
-	pllinclk = DIV_ROUND_CLOSEST(input->refclk, pll_prediv);
-	if (pllinclk < 4000000 || pllinclk > 40000000) {
-		log_error("invalid pll input clock: %d Hz\n", pllinclk);
+	if (tc358746_get_line_timing(input, self->format, &self->csi, &t) < 0 ||
+	    tc358746_get_c_hactive(&t, self->vb_fifo, &c_hactive_fs) < 0)
 		return -EINVAL;
+
+	lines = (u64)input->height + input->vblank;
+	p_htotal = (u64)self->format->ppp * input->width + input->hblank;
+
+	/* the frame is a whole number of pclk cycles, don't sum up the lines */
+	if (tc358746_mul_overflow(p_htotal, lines, &p_htotal) ||
+	    tc358746_cycles_fs(p_htotal, t.pclk, &frame_fs) ||
+	    tc358746_add_overflow(c_hactive_fs, t.c_hs_lp_hs_fs, &c_line_fs) ||
+	    tc358746_mul_overflow(c_line_fs, lines, &c_frame_fs) ||
+	    tc358746_mul_overflow(t.c_data_fs, (u64)input->height * 10000,
+				  &c_data_frame_fs)) {
+		log_error("frame timing overflow: %u lines\n", input->height);
+		return -EOVERFLOW;
 	}
 
-	pll->pllinclk_hz = pllinclk;
+	if (!p_htotal || !c_frame_fs)
+		return -EINVAL;
+
+	frame->line_period_ps = t.p_htotal_fs / 1000;
+	frame->frame_period_ps = frame_fs / 1000;
+	frame->framerate = t.pclk * 1000000 / p_htotal;
+	frame->max_framerate = TC358746_PS_PER_FPS /
+			       DIV_ROUND_UP(c_frame_fs, 1000);
+	frame->link_utilisation = c_data_frame_fs / frame_fs;
 
 	return 0;
 }
 
-static void tc358746_setup_pll_post(struct tc358746_pll *pll,
-				    struct tc358746_csi *csi)
+/*
+ * Headroom of the configuration @self calculated for @input: the line timing
+ * behind the fifo size and how far every timing count is above the lower
+ * limit it was calculated for.
+ */
+int tc358746_get_metrics(const struct tc358746 *self,
+			 const struct tc358746_input *input,
+			 struct tc358746_metrics *m)
 {
-	u16 pll_frs = csi->speed_range;
+	struct tc358746_line_timing t;
+	struct tc358746_dphy_timing d;
+	u64 c_hactive_fs, c_lp_window_fs, clk_hs_fs;
+
+	if (tc358746_get_line_timing(input, self->format, &self->csi, &t) < 0 ||
+	    tc358746_get_c_hactive(&t, self->vb_fifo, &c_hactive_fs) < 0 ||
+	    !t.p_htotal_fs)
+		return -EINVAL;
+
+	c_lp_window_fs = t.p_htotal_fs > c_hactive_fs ?
+			 t.p_htotal_fs - c_hactive_fs : 0;
+
+	m->line_period_ps = t.p_htotal_fs / 1000;
+	m->p_hactive_ps = t.p_hactive_fs / 1000;
+	m->c_data_ps = t.c_data_fs / 1000;
+	m->c_fifo_delay_ps = (c_hactive_fs - t.c_data_fs) / 1000;
+	m->c_hactive_ps = c_hactive_fs / 1000;
+	m->c_lp_window_ps = c_lp_window_fs / 1000;
+	m->csi_hs_lp_hs_ps = self->csi.csi_hs_lp_hs_ps;
+	m->hactive_slack_ps = tc358746_slack_ps(c_hactive_fs, t.p_hactive_fs);
+	m->htotal_slack_ps = tc358746_slack_ps(t.p_htotal_fs, c_hactive_fs);
+	m->lp_slack_ps = tc358746_slack_ps(c_lp_window_fs, t.c_hs_lp_hs_fs);
+	m->link_utilisation = t.c_data_fs * 10000 / t.p_htotal_fs;
 
 	/*
-	 * Calculation:
-	 * speed_per_lane = (pllinclk_hz * (fbd + 1)) / 2^frs
-	 *
-	 * Calculation used by REF_02:
-	 * speed_per_lane = (pllinclk_hz * fbd) / 2^frs
+	 * The data lanes are in HS for the payload. A continuous clock lane
+	 * never leaves HS, a discontinuous one only around the payload and the
+	 * transitions.
 	 */
-#if 1
-	pll->pll_fbd =
-	    DIV_ROUND_CLOSEST(csi->speed_per_lane, pll->pllinclk_hz);
-	pll->pll_fbd <<= pll_frs;
-	pll->pll_fbd -= csi->speed_range;
-#else
-	pll->pll_fbd = csi->speed_per_lane / pll->pllinclk_hz;
-	pll->pll_fbd <<= pll_frs;
-#endif
+	clk_hs_fs = self->csi.is_continuous_clk ? t.p_htotal_fs :
+		    min(t.c_data_fs + t.c_hs_lp_hs_fs, t.p_htotal_fs);
+	m->hs_lane_load = (t.c_data_fs * self->csi.lane_num + clk_hs_fs) *
+			  10000 / t.p_htotal_fs;
+
+	tc358746_get_dphy_timing(&self->csi, &d);
+
+	m->lineinit_margin_ps =
+	    tc358746_slack_ps(d.lineinit_fs, TC358746_LINEINIT_MIN_US *
+					     1000 * TC358746_FS_PER_NS);
+	m->lptxtime_margin_ps =
+	    tc358746_slack_ps(d.lptxtime_fs, TC358746_LPTXTIME_MIN_NS *
+					     TC358746_FS_PER_NS);
+	m->twakeup_margin_ps =
+	    tc358746_slack_ps(d.twakeup_fs, TC358746_TWAKEUP_MIN_US *
+					    1000 * TC358746_FS_PER_NS);
+	m->tclk_prepare_margin_ps =
+	    tc358746_slack_ps(d.tclk_prepare_fs, TC358746_LPTXTIME_MIN_NS *
+						 TC358746_FS_PER_NS);
+	m->tclk_zero_margin_ps =
+	    tc358746_slack_ps(d.tclk_zero_fs, TC358746_TCLKZERO_MIN_NS *
+					      TC358746_FS_PER_NS);
+	m->tclk_trail_margin_ps =
+	    tc358746_slack_ps(d.tclk_trail_fs, TC358746_TCLKTRAIL_MIN_NS *
+					       TC358746_FS_PER_NS);
+	m->tclk_post_margin_ps =
+	    tc358746_slack_ps(d.tclk_post_fs, TC358746_TCLKPOST_MIN_NS *
+					      TC358746_FS_PER_NS +
+					      tc358746_fs(52, d.spl));
+	m->ths_prepare_margin_ps =
+	    tc358746_slack_ps(d.ths_prepare_fs, TC358746_THSPREPARE_MIN_NS *
+						TC358746_FS_PER_NS +
+						tc358746_fs(4, d.spl));
+	m->ths_zero_margin_ps =
+	    tc358746_slack_ps(d.ths_zero_fs, TC358746_THSZERO_MIN_NS *
+					     TC358746_FS_PER_NS +
+					     tc358746_fs(10, d.spl));
+	m->ths_trail_margin_ps =
+	    tc358746_slack_ps(d.ths_trail_fs, TC358746_THSTRAIL_MIN_NS *
+					      TC358746_FS_PER_NS +
+					      tc358746_fs(4, d.spl));
+
+	return 0;
 }
 
-int tc358746_calculate(struct tc358746 *self,
-		       const struct tc358746_input *input)
+/*
+ * Whether the csi payload of a line at @spl bps per lane, plus the 4 HS clock
+ * cycles the line starts with, is shorter than the parallel line and, if a
+ * frame rate is asked for, carries it. The fifo delay and the HS-LP-HS
+ * transition only add to that, see tc358746_fifo_size_fits() and
+ * tc358746_frame_timing(), so every feasible lane rate passes. A faster lane
+ * never fails where a slower one passed.
+ */
+static bool tc358746_lane_rate_carries(const struct tc358746_input *input,
+				       const struct tc358746_mbus_fmt *format,
+				       u64 p_htotal_fs, u64 spl)
+{
+	u64 c_fs;
+
+	if (tc358746_cycles_fs((u64)format->bpp * input->width,
+			       spl * input->num_lanes, &c_fs) ||
+	    tc358746_add_overflow(c_fs, tc358746_fs(4, spl >> 3), &c_fs) ||
+	    c_fs >= p_htotal_fs)
+		return false;
+
+	if (!input->framerate || !input->height)
+		return true;
+
+	if (tc358746_mul_overflow(c_fs, (u64)input->height + input->vblank,
+				  &c_fs))
+		return false;
+
+	return TC358746_PS_PER_FPS / DIV_ROUND_UP(c_fs, 1000) >=
+	       input->framerate;
+}
+
+/*
+ * The lowest lane rate in [@lo, @hi] bps passing tc358746_lane_rate_carries(),
+ * @hi if none does. Inputs the calculation rejects anyway get @lo, the search
+ * reports them.
+ */
+static u64 tc358746_lane_rate_floor(const struct tc358746_input *input,
+				    u64 lo, u64 hi)
 {
 	const struct tc358746_mbus_fmt *format;
-	struct tc358746_pll pll;
-	struct tc358746_csi csi;
-	u16 vb_fifo;
+	u64 p_htotal_fs, mid;
 
 	format = tc358746_get_format(input->mbus_fmt);
-	if (!format)
+	if (!format || input->num_lanes < 1 || input->num_lanes > 4 ||
+	    input->pclk < 1000 ||
+	    tc358746_cycles_fs((u64)format->ppp * input->width + input->hblank,
+			       input->pclk, &p_htotal_fs))
+		return lo;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (tc358746_lane_rate_carries(input, format, p_htotal_fs, mid))
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo;
+}
+
+static bool tc358746_link_freq_fits(struct tc358746_ctx *ctx,
+				    struct tc358746 *self,
+				    const struct tc358746_input *input,
+				    struct tc358746_diag *diag)
+{
+	struct tc358746_frame frame;
+
+	if (tc358746_ctx_calculate(ctx, self, input, diag) < 0)
+		return false;
+
+	if (!input->framerate || !input->height)
+		return true;
+
+	if (tc358746_frame_timing(self, input, &frame) < 0) {
+		tc358746_fail(diag, TC358746_REASON_OVERFLOW, 0, 0);
+		return false;
+	}
+
+	if (frame.max_framerate < input->framerate) {
+		tc358746_fail(diag, TC358746_REASON_FRAMERATE,
+			      frame.max_framerate, input->framerate);
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Find the lowest link frequency, as a multiple of @resolution Hz, for which
+ * tc358746_calculate() succeeds. If input->framerate and input->height are
+ * set, the link also has to carry that frame rate, see max_framerate of
+ * tc358746_frame_timing(). Only input->link_frequency is varied, on
+ * success @self holds the parameters for the returned @link_frequency.
+ *
+ * The link frequency only matters through the pll setting it selects, see
+ * tc358746_pll_rate(), so the search tries the achievable lane rates in
+ * ascending order, each with the lowest link frequency selecting it. The
+ * feasibility isn't monotonic in the lane rate, the divider rounding and the
+ * fifo and line checks make it toggle, so the candidates are pruned with
+ * bounds only:
+ *
+ * - the lane rate (62.5 Mbps - 1 Gbps) and HS byte clock (<= 125 MHz) bounds
+ *   of tc358746_setup_pll() and tc358746_calculate_csi_txtimings(),
+ * - the lowest lane rate which fits the payload into the line and the frame,
+ *   see tc358746_lane_rate_floor(),
+ * - the VCO range, per pre-divider and frs, see tc358746_pll_windows().
+ *
+ * A failure that rules out every higher frequency, or every frequency, ends
+ * the walk early, see tc358746_diag_prune().
+ */
+int tc358746_find_link_freq(struct tc358746 *self,
+			    const struct tc358746_input *input,
+			    u64 resolution, u64 *link_frequency)
+{
+	struct tc358746_pll_window win[TC358746_PLL_PRD_MAX *
+				       (TC358746_PLL_FRS_MAX + 1)];
+	struct tc358746_input _input = *input;
+	struct tc358746_pll_rate rate, prev;
+	struct tc358746_diag diag;
+	struct tc358746_ctx ctx;
+	struct tc358746 param;
+	unsigned int win_num;
+	bool tried = false;
+	u64 lo, hi, freq;
+
+	if (!resolution)
+		return -EINVAL;
+
+	/* only the link frequency varies, the format stays cached */
+	tc358746_ctx_init(&ctx);
+
+	/* work in units of resolution */
+	lo = DIV_ROUND_UP(DIV_ROUND_UP((u64)TC358746_LANE_RATE_MIN, 2),
+			  resolution);
+	hi = min_t(u64, TC358746_LANE_RATE_MAX / 2,
+		   (u64)TC358746_HSBYTECLK_MAX * 8 / 2) / resolution;
+	if (lo > hi)
+		return -EINVAL;
+
+	win_num = tc358746_pll_windows(input->refclk,
+			tc358746_lane_rate_floor(input, 2 * lo * resolution,
+						 2 * hi * resolution),
+			2 * hi * resolution, win, &prev);
+
+	while (tc358746_pll_windows_next(input->refclk, win, win_num, &rate)) {
+		/* every link frequency up to half the rate below selects that */
+		freq = max(lo, prev.num / (2 * resolution * prev.den) + 1);
+		prev = rate;
+		if (2 * freq * resolution * rate.den > rate.num)
+			continue;
+
+		tried = true;
+		_input.link_frequency = freq * resolution;
+		if (tc358746_link_freq_fits(&ctx, &param, &_input, &diag)) {
+			*self = param;
+			*link_frequency = _input.link_frequency;
+			return 0;
+		}
+
+		/* the rest of the walk can't succeed either */
+		if (tc358746_diag_prune(&diag) == TC358746_PRUNE_ALL ||
+		    tc358746_diag_prune(&diag) == TC358746_PRUNE_ABOVE)
+			break;
+	}
+
+	/* nothing left after pruning, let the highest frequency tell why */
+	if (!tried) {
+		_input.link_frequency = hi * resolution;
+		tc358746_link_freq_fits(&ctx, &param, &_input, &diag);
+	}
+
+	log_error("no link frequency found: %s, %llu vs %llu\n",
+		  tc358746_reason_str(diag.reason),
+		  (unsigned long long)diag.value,
+		  (unsigned long long)diag.bound);
+	return -EINVAL;
+}
+
+/*
+ * Find the smallest input->hblank for which tc358746_calculate() succeeds,
+ * i.e. the highest frame rate of the resolution at this pclk and link. Only
+ * input->hblank is varied, on success @self holds the parameters for the
+ * returned @hblank. If @frame is given, input->height has to be set and
+ * @frame is filled as by tc358746_frame_timing() at the returned @hblank.
+ *
+ * The fifo size doesn't depend on the hblank, so it is the one
+ * tc358746_adjust_fifo_size() picks for any hblank. The remaining conditions
+ * of tc358746_fifo_size_fits() only need the parallel line to be longer than
+ * the csi one:
+ *
+ * Calculation:
+ * pclk_period * (pclk_per_pixel * width + hblank) > c_hactive + csi_hs_lp_hs
+ */
+int tc358746_find_min_hblank(struct tc358746 *self,
+			     const struct tc358746_input *input,
+			     unsigned int *hblank, struct tc358746_frame *frame)
+{
+	struct tc358746_input _input = *input;
+	struct tc358746_line_timing t;
+	struct tc358746_ctx ctx;
+	unsigned int fifo_size;
+	u64 c_line_fs, _hblank;
+
+	/* every stage but the fifo, none of them depends on the hblank */
+	tc358746_ctx_init(&ctx);
+	if (tc358746_ctx_run(&ctx, input, TC358746_STAGE_TIMINGS, NULL,
+			     false) < 0)
+		return -EINVAL;
+
+	_input.hblank = 0;
+	if (tc358746_get_line_timing(&_input, ctx.format, &ctx.csi, &t) < 0)
+		return -EINVAL;
+
+	fifo_size = tc358746_min_fifo_size(&t);
+	if (fifo_size >= TC358746_MAX_FIFO_SIZE ||
+	    tc358746_get_c_hactive(&t, fifo_size, &c_line_fs) < 0 ||
+	    tc358746_add_overflow(c_line_fs, t.c_hs_lp_hs_fs, &c_line_fs)) {
+		log_error("no hblank found\n");
+		return -EINVAL;
+	}
+
+	/* c_hactive > p_hactive holds for the minimal fifo size */
+	_hblank = tc358746_cycles_above(c_line_fs, t.pclk) -
+		  (u64)ctx.format->ppp * input->width;
+	if (_hblank != (unsigned int)_hblank) {
+		log_error("no hblank found\n");
 		return -EINVAL;
+	}
 
-	if (tc358746_setup_pll(input, &pll) < 0)
+	_input.hblank = _hblank;
+	if (tc358746_ctx_calculate(&ctx, self, &_input, NULL) < 0)
 		return -EINVAL;
 
-	if (tc358746_set_lane_settings(input, &pll, &csi) < 0)
+	if (frame && tc358746_frame_timing(self, &_input, frame) < 0)
 		return -EINVAL;
 
-	tc358746_setup_pll_post(&pll, &csi);
+	*hblank = _hblank;
+
+	return 0;
+}
+
+/* plans ordered by lane rate, then pclk */
+static bool tc358746_plan_before(const struct tc358746_plan *a,
+				 const struct tc358746_plan *b)
+{
+	if (a->param.csi.speed_per_lane != b->param.csi.speed_per_lane)
+		return a->param.csi.speed_per_lane < b->param.csi.speed_per_lane;
+
+	return a->input.pclk < b->input.pclk;
+}
+
+/*
+ * Largest hblank at which the frame still runs at input->framerate, -1 if
+ * even no hblank is too long.
+ *
+ * Calculation:
+ * (pclk_per_pixel * width + hblank) * (height + vblank) <=
+ *	pclk * 1000000 / framerate
+ */
+static long long tc358746_plan_max_hblank(const struct tc358746_input *input,
+					  const struct tc358746_mbus_fmt *format)
+{
+	u64 lines, p_htotal, p_hactive;
+
+	lines = (u64)input->height + input->vblank;
+	p_htotal = (u64)input->pclk * 1000000 / input->framerate / lines;
+	p_hactive = (u64)format->ppp * input->width;
+
+	if (p_htotal <= p_hactive)
+		return -1;
 
-	if (tc358746_calculate_csi_txtimings(&csi) < 0)
+	return min_t(u64, p_htotal - p_hactive, ~0U);
+}
+
+/*
+ * Plan the parallel and csi timing of a mode: input->mbus_fmt, refclk,
+ * num_lanes, discontinuous_clk, hs_lp_hs_*, width, height, vblank and
+ * framerate are given, the pclk, hblank and link frequency are chosen.
+ *
+ * Every pclk from @pclk_min to @pclk_max in @pclk_step Hz steps is tried
+ * which can carry the frame rate at all. The hblank is the largest one
+ * still reaching input->framerate, as that leaves the most time per line
+ * to the csi side, and the link frequency the lowest one, in multiples of
+ * @resolution Hz, which carries the line, see tc358746_find_link_freq().
+ * A shorter hblank, down to tc358746_find_min_hblank(), works as well.
+ *
+ * The best @num_plans plans are stored in @plans, lowest lane rate first,
+ * then lowest pclk. Returns the number of plans stored.
+ */
+int tc358746_plan(const struct tc358746_input *input,
+		  unsigned int pclk_min, unsigned int pclk_max,
+		  unsigned int pclk_step, u64 resolution,
+		  struct tc358746_plan *plans, unsigned int num_plans)
+{
+	const struct tc358746_mbus_fmt *format;
+	struct tc358746_plan plan;
+	unsigned int found = 0, pos;
+	u64 lines, pclk, first;
+	long long hblank;
+
+	format = tc358746_get_format(input->mbus_fmt);
+	if (!format || !input->width || !input->height || !input->framerate ||
+	    !pclk_step || !num_plans) {
+		log_error("plan needs format, width, height and framerate\n");
 		return -EINVAL;
+	}
 
-	if (tc358746_adjust_fifo_size(input, format, &csi, &vb_fifo) < 0)
+	/*
+	 * Bound the pclk from below by a line of active pixels only:
+	 * pclk >= framerate * (height + vblank) * pclk_per_pixel * width
+	 */
+	lines = (u64)input->height + input->vblank;
+	if (tc358746_mul_overflow((u64)input->framerate * lines,
+				  (u64)format->ppp * input->width, &pclk)) {
+		log_error("plan pclk bound overflows\n");
 		return -EINVAL;
+	}
+	pclk /= 1000000;
+
+	first = pclk_min;
+	if (pclk > first)
+		first += DIV_ROUND_UP(pclk - first, pclk_step) * (u64)pclk_step;
+	pclk_max = min(pclk_max, TC358746_PCLK_MAX);
 
-	self->format = format;
-	self->pll = pll;
-	self->csi = csi;
-	self->vb_fifo = vb_fifo;
+	for (pclk = max_t(u64, first, 1000); pclk <= pclk_max;
+	     pclk += pclk_step) {
+		plan.input = *input;
+		plan.input.pclk = pclk;
+
+		hblank = tc358746_plan_max_hblank(&plan.input, format);
+		if (hblank < 0)
+			continue;
+		plan.input.hblank = hblank;
+
+		if (tc358746_find_link_freq(&plan.param, &plan.input,
+					    resolution,
+					    &plan.input.link_frequency) < 0 ||
+		    tc358746_frame_timing(&plan.param, &plan.input,
+					  &plan.frame) < 0)
+			continue;
+
+		if (found < num_plans)
+			found++;
+		else if (!tc358746_plan_before(&plan, plans + found - 1))
+			continue;
+
+		for (pos = found - 1;
+		     pos > 0 && tc358746_plan_before(&plan, plans + pos - 1);
+		     pos--)
+			plans[pos] = plans[pos - 1];
+		plans[pos] = plan;
+	}
+
+	if (!found)
+		log_error("no plan found\n");
+
+	return found;
+}
+
+/* @a is the better choice of tc358746_find_lanes() */
+static bool tc358746_lanes_before(const struct tc358746_plan *a, u32 a_load,
+				  const struct tc358746_plan *b, u32 b_load,
+				  enum tc358746_lane_policy policy)
+{
+	u32 a_rate = a->param.csi.speed_per_lane;
+	u32 b_rate = b->param.csi.speed_per_lane;
+
+	if (policy == TC358746_LANES_MIN_POWER && a_load != b_load)
+		return a_load < b_load;
+	if (a_rate != b_rate)
+		return a_rate < b_rate;
+	if (a_load != b_load)
+		return a_load < b_load;
+
+	return a->input.num_lanes < b->input.num_lanes;
+}
+
+/*
+ * Choose input->num_lanes (1 - @max_lanes) and input->discontinuous_clk for
+ * the rest of @input. For every combination the lowest link frequency is
+ * searched, in multiples of @resolution Hz, see tc358746_find_link_freq().
+ * Of those the one with the lowest lane rate or the lowest hs_lane_load of
+ * tc358746_get_metrics() is chosen, depending on @policy. Both clock modes
+ * use the csi_hs_lp_hs_ps of input->hs_lp_hs_model.
+ *
+ * On success @plan holds the input with the chosen lanes, clock mode and
+ * link frequency, its parameters and, if input->height is set, its frame
+ * timing.
+ */
+int tc358746_find_lanes(const struct tc358746_input *input, int max_lanes,
+			u64 resolution, enum tc358746_lane_policy policy,
+			struct tc358746_plan *plan)
+{
+	struct tc358746_metrics metrics;
+	struct tc358746_plan try;
+	u32 load, best_load = 0;
+	bool found = false;
+	int lanes, clk;
+
+	max_lanes = min(max_lanes, 4);
+
+	for (lanes = 1; lanes <= max_lanes; lanes++) {
+		for (clk = 0; clk <= 1; clk++) {
+			try.input = *input;
+			try.input.num_lanes = lanes;
+			try.input.discontinuous_clk = clk;
+
+			if (tc358746_find_link_freq(&try.param, &try.input,
+						    resolution,
+						    &try.input.link_frequency) < 0 ||
+			    tc358746_get_metrics(&try.param, &try.input,
+						 &metrics) < 0)
+				continue;
+			load = metrics.hs_lane_load;
+
+			if (found && !tc358746_lanes_before(&try, load, plan,
+							    best_load, policy))
+				continue;
+
+			*plan = try;
+			best_load = load;
+			found = true;
+		}
+	}
+
+	if (!found) {
+		log_error("no lane count fits\n");
+		return -EINVAL;
+	}
+
+	plan->frame = (struct tc358746_frame){ 0 };
+	if (input->height &&
+	    tc358746_frame_timing(&plan->param, &plan->input, &plan->frame) < 0)
+		return -EINVAL;
 
 	return 0;
 }
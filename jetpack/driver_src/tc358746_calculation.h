@@ -43,7 +43,7 @@ struct tc358746_csi {
 	u32 ths_zerocnt;
 	u32 ths_trailcnt;
 
-	unsigned int csi_hs_lp_hs_ps;
+	u64 csi_hs_lp_hs_ps;
 };
 
 struct tc358746 {
@@ -53,6 +53,12 @@ struct tc358746 {
 	u16 vb_fifo;
 };
 
+/* how tc358746_calculate() estimates the csi hs->lp->hs transition */
+enum tc358746_hs_lp_hs_model {
+	TC358746_HS_LP_HS_LEGACY,	/* REF_02 based, with fudge factors */
+	TC358746_HS_LP_HS_EXACT,	/* sum of the programmed D-PHY states */
+};
+
 struct tc358746_input {
 	/* get_format */
 	int mbus_fmt;
@@ -62,13 +68,191 @@ struct tc358746_input {
 	u64 link_frequency;
 	int num_lanes;
 	bool discontinuous_clk;
+	/* calculate_csi_txtimings */
+	enum tc358746_hs_lp_hs_model hs_lp_hs_model;
+	unsigned int hs_lp_hs_margin;	/* % added to the exact model */
 	/* adjust_fifo_size */
 	unsigned int pclk;
 	unsigned int width;
 	unsigned int hblank;
+	/* frame_timing, not needed by tc358746_calculate() */
+	unsigned int height;
+	unsigned int vblank;
+	u32 framerate;		/* fps * 1000000, 0 if not required */
+};
+
+/*
+ * Why tc358746_calculate_diag() failed. The bound is the limit the value
+ * violated, in the unit of the value.
+ */
+enum tc358746_reason {
+	TC358746_REASON_NONE,
+	TC358746_REASON_FORMAT,		/* mbus_fmt, unsupported */
+	TC358746_REASON_WIDTH,		/* width * bpp, not a multiple of 8 */
+	TC358746_REASON_REFCLK,		/* refclk, 6 - 40 MHz */
+	TC358746_REASON_LANE_RATE_LOW,	/* 2 * link_frequency, bps */
+	TC358746_REASON_LANE_RATE_HIGH,	/* 2 * link_frequency, bps */
+	TC358746_REASON_PLL,		/* 2 * link_frequency, no pll setting */
+	TC358746_REASON_LANES,		/* num_lanes, 1 - 4 */
+	TC358746_REASON_HSBYTECLK,	/* hs byte clock, Hz */
+	TC358746_REASON_PCLK,		/* pclk, Hz */
+	TC358746_REASON_OVERFLOW,	/* line timing overflow */
+	TC358746_REASON_FIFO_DEPTH,	/* fifo size, no size delays enough */
+	TC358746_REASON_LINE,		/* line period ps, shortest line */
+	TC358746_REASON_FRAMERATE,	/* max frame rate, input->framerate */
+};
+
+struct tc358746_diag {
+	enum tc358746_reason reason;
+	u64 value;
+	u64 bound;
+};
+
+/* what a failure tells about other link frequencies */
+enum tc358746_prune {
+	TC358746_PRUNE_NONE,		/* others may work */
+	TC358746_PRUNE_ABOVE,		/* higher ones fail as well */
+	TC358746_PRUNE_BELOW,		/* lower ones fail as well */
+	TC358746_PRUNE_ALL,		/* doesn't depend on the link frequency */
+};
+
+/*
+ * Frame level view of a configuration, see tc358746_frame_timing().
+ * Frame rates are in fps * 1000000 like framerate_factor in the device tree.
+ */
+struct tc358746_frame {
+	u64 line_period_ps;	/* parallel line, active + hblank */
+	u64 frame_period_ps;	/* line_period_ps * (height + vblank) */
+	u64 framerate;
+	u64 max_framerate;	/* with the shortest line the link can carry */
+	u32 link_utilisation;	/* HS payload share of the frame, 0.01 % */
+};
+
+/*
+ * Timing headroom of a configuration, see tc358746_get_metrics(). A slack or
+ * margin < 0 means the condition is violated, 0 that it is met exactly. The
+ * line inequalities are strict, so a slack of 0 fails them, while the counts
+ * only have to reach their lower limit.
+ */
+struct tc358746_metrics {
+	/* line, the inequalities of tc358746_adjust_fifo_size() */
+	u64 line_period_ps;	/* parallel line, active + hblank */
+	u64 p_hactive_ps;	/* parallel active */
+	u64 c_data_ps;		/* csi HS payload */
+	u64 c_fifo_delay_ps;
+	u64 c_hactive_ps;	/* c_data_ps + c_fifo_delay_ps */
+	u64 c_lp_window_ps;	/* line_period_ps - c_hactive_ps */
+	u64 csi_hs_lp_hs_ps;	/* has to fit into c_lp_window_ps */
+	s64 hactive_slack_ps;	/* c_hactive_ps - p_hactive_ps */
+	s64 htotal_slack_ps;	/* line_period_ps - c_hactive_ps */
+	s64 lp_slack_ps;	/* c_lp_window_ps - csi_hs_lp_hs_ps */
+	u32 link_utilisation;	/* c_data_ps share of the line, 0.01 % */
+	/*
+	 * Time the data lanes and the clock lane spend in HS per line, summed
+	 * up, 0.01 % of the line. A proxy of the link power.
+	 */
+	u32 hs_lane_load;
+
+	/* programmed duration minus the lower limit of each count */
+	s64 lineinit_margin_ps;
+	s64 lptxtime_margin_ps;
+	s64 twakeup_margin_ps;
+	s64 tclk_prepare_margin_ps;
+	s64 tclk_zero_margin_ps;
+	s64 tclk_trail_margin_ps;
+	s64 tclk_post_margin_ps;
+	s64 ths_prepare_margin_ps;
+	s64 ths_zero_margin_ps;
+	s64 ths_trail_margin_ps;
+};
+
+/* one solution of tc358746_plan() */
+struct tc358746_plan {
+	struct tc358746_input input;	/* with pclk, hblank, link_frequency */
+	struct tc358746 param;
+	struct tc358746_frame frame;
+};
+
+/* what tc358746_find_lanes() minimises first */
+enum tc358746_lane_policy {
+	TC358746_LANES_MIN_RATE,	/* lane rate, then hs_lane_load */
+	TC358746_LANES_MIN_POWER,	/* hs_lane_load, then lane rate */
+};
+
+/* the stages of tc358746_calculate(), in order */
+enum tc358746_stage {
+	TC358746_STAGE_FORMAT,
+	TC358746_STAGE_PLL,
+	TC358746_STAGE_LANES,
+	TC358746_STAGE_TIMINGS,
+	TC358746_STAGE_FIFO,
+	TC358746_STAGE_DONE,
+};
+
+/*
+ * Results of the stages of the last input, see tc358746_ctx_calculate().
+ * Set up with tc358746_ctx_init().
+ */
+struct tc358746_ctx {
+	struct tc358746_input input;
+	enum tc358746_stage done;	/* the stages before are valid */
+	const struct tc358746_mbus_fmt *format;
+	struct tc358746_pll pll;
+	struct tc358746_csi csi;
+	u16 vb_fifo;
+};
+
+/*
+ * Precalculated parameters of one input, generated at build time by
+ * 'calc header', see tc358746_lookup()
+ */
+struct tc358746_table_entry {
+	struct tc358746_input input;
+	struct tc358746_pll pll;
+	struct tc358746_csi csi;
+	u16 vb_fifo;
 };
 
+const struct tc358746_mbus_fmt *tc358746_find_format(u32 code);
 int tc358746_calculate(struct tc358746 *self,
 		       const struct tc358746_input *input);
+#ifdef TC358746_FIFO_REFERENCE
+/* same as tc358746_calculate(), but sizes the fifo by trying every size */
+int tc358746_calculate_ref(struct tc358746 *self,
+			   const struct tc358746_input *input);
+#endif
+int tc358746_calculate_diag(struct tc358746 *self,
+			    const struct tc358746_input *input,
+			    struct tc358746_diag *diag);
+void tc358746_ctx_init(struct tc358746_ctx *ctx);
+int tc358746_ctx_calculate(struct tc358746_ctx *ctx, struct tc358746 *self,
+			   const struct tc358746_input *input,
+			   struct tc358746_diag *diag);
+const char *tc358746_reason_str(enum tc358746_reason reason);
+enum tc358746_prune tc358746_diag_prune(const struct tc358746_diag *diag);
+int tc358746_frame_timing(const struct tc358746 *self,
+			  const struct tc358746_input *input,
+			  struct tc358746_frame *frame);
+int tc358746_get_metrics(const struct tc358746 *self,
+			 const struct tc358746_input *input,
+			 struct tc358746_metrics *metrics);
+int tc358746_find_link_freq(struct tc358746 *self,
+			    const struct tc358746_input *input,
+			    u64 resolution, u64 *link_frequency);
+int tc358746_find_min_hblank(struct tc358746 *self,
+			     const struct tc358746_input *input,
+			     unsigned int *hblank, struct tc358746_frame *frame);
+int tc358746_plan(const struct tc358746_input *input,
+		  unsigned int pclk_min, unsigned int pclk_max,
+		  unsigned int pclk_step, u64 resolution,
+		  struct tc358746_plan *plans, unsigned int num_plans);
+int tc358746_find_lanes(const struct tc358746_input *input, int max_lanes,
+			u64 resolution, enum tc358746_lane_policy policy,
+			struct tc358746_plan *plan);
+
+int tc358746_lookup(struct tc358746 *self,
+		    const struct tc358746_input *input,
+		    const struct tc358746_table_entry *table,
+		    unsigned int table_size);
 
 #endif
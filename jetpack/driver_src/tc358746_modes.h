@@ -0,0 +1,293 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * tc358746 parameters of the dione-ir device tree modes
+ *
+ * Generated by 'calc header', do not edit.
+ */
+
+#ifndef __TC358746_MODES_H
+#define __TC358746_MODES_H
+
+#include <uapi/linux/media-bus-format.h>
+#include "tc358746_calculation.h"
+
+static const struct tc358746_table_entry tc358746_modes[] = {
+	{
+		/* config 640 */
+		.input = {
+			.mbus_fmt = MEDIA_BUS_FMT_RGB888_1X24,
+			.refclk = 24000000,			/* Hz */
+			.link_frequency = 249000000,		/* Hz */
+			.num_lanes = 2,
+			.discontinuous_clk = false,
+			.hs_lp_hs_model = TC358746_HS_LP_HS_LEGACY,
+			.hs_lp_hs_margin = 0,		/* % */
+			.pclk = 20000000,			/* Hz */
+			.width = 640,
+			.hblank = 54,
+			.height = 480,
+			.vblank = 0,
+			.framerate = 60020000,		/* fps * 1000000 */
+		},
+		.pll = {
+			.pllinclk_hz = 4000000,
+			.pll_prd = 6,
+			.pll_fbd = 249,
+		},
+		.csi = {
+			.speed_range = 1,			/* 250MHz – 500MHz HSCK frequency */
+			.unit_clk_hz = 2000000,
+			.unit_clk_mul = 249,
+			.speed_per_lane = 498000000,		/* bps/lane */
+			.lane_num = 2,
+			.is_continuous_clk = true,		/* CSI clock during LP enabled */
+
+			/* CSI2-TX Parameters */
+			.lineinitcnt = 3424,
+			.lptxtimecnt = 3,
+			.twakeupcnt = 18674,
+			.tclk_preparecnt = 3,
+			.tclk_zerocnt = 17,
+			.tclk_trailcnt = 0,
+			.tclk_postcnt = 8,
+			.ths_preparecnt = 3,
+			.ths_zerocnt = 0,
+			.ths_trailcnt = 1,
+
+			.csi_hs_lp_hs_ps = 803213,		/* 803 ns */
+		},
+		.vb_fifo = 248,
+	},
+	{
+		/* config 640 */
+		.input = {
+			.mbus_fmt = MEDIA_BUS_FMT_RGB888_1X24,
+			.refclk = 24000000,			/* Hz */
+			.link_frequency = 500000000,		/* Hz */
+			.num_lanes = 2,
+			.discontinuous_clk = false,
+			.hs_lp_hs_model = TC358746_HS_LP_HS_LEGACY,
+			.hs_lp_hs_margin = 0,		/* % */
+			.pclk = 20000000,			/* Hz */
+			.width = 640,
+			.hblank = 54,
+			.height = 480,
+			.vblank = 0,
+			.framerate = 60020000,		/* fps * 1000000 */
+		},
+		.pll = {
+			.pllinclk_hz = 4000000,
+			.pll_prd = 6,
+			.pll_fbd = 250,
+		},
+		.csi = {
+			.speed_range = 0,			/* 500MHz - 1GHz HSCK frequency */
+			.unit_clk_hz = 4000000,
+			.unit_clk_mul = 250,
+			.speed_per_lane = 1000000000,		/* bps/lane */
+			.lane_num = 2,
+			.is_continuous_clk = true,		/* CSI clock during LP enabled */
+
+			/* CSI2-TX Parameters */
+			.lineinitcnt = 6875,
+			.lptxtimecnt = 6,
+			.twakeupcnt = 21428,
+			.tclk_preparecnt = 6,
+			.tclk_zerocnt = 36,
+			.tclk_trailcnt = 4,
+			.tclk_postcnt = 12,
+			.ths_preparecnt = 6,
+			.ths_zerocnt = 8,
+			.ths_trailcnt = 5,
+
+			.csi_hs_lp_hs_ps = 544000,		/* 544 ns */
+		},
+		.vb_fifo = 365,
+	},
+	{
+		/* config 1280 */
+		.input = {
+			.mbus_fmt = MEDIA_BUS_FMT_RGB888_1X24,
+			.refclk = 24000000,			/* Hz */
+			.link_frequency = 500000000,		/* Hz */
+			.num_lanes = 2,
+			.discontinuous_clk = false,
+			.hs_lp_hs_model = TC358746_HS_LP_HS_LEGACY,
+			.hs_lp_hs_margin = 0,		/* % */
+			.pclk = 83000000,			/* Hz */
+			.width = 1280,
+			.hblank = 54,
+			.height = 1024,
+			.vblank = 0,
+			.framerate = 60756000,		/* fps * 1000000 */
+		},
+		.pll = {
+			.pllinclk_hz = 4000000,
+			.pll_prd = 6,
+			.pll_fbd = 250,
+		},
+		.csi = {
+			.speed_range = 0,			/* 500MHz - 1GHz HSCK frequency */
+			.unit_clk_hz = 4000000,
+			.unit_clk_mul = 250,
+			.speed_per_lane = 1000000000,		/* bps/lane */
+			.lane_num = 2,
+			.is_continuous_clk = true,		/* CSI clock during LP enabled */
+
+			/* CSI2-TX Parameters */
+			.lineinitcnt = 6875,
+			.lptxtimecnt = 6,
+			.twakeupcnt = 21428,
+			.tclk_preparecnt = 6,
+			.tclk_zerocnt = 36,
+			.tclk_trailcnt = 4,
+			.tclk_postcnt = 12,
+			.ths_preparecnt = 6,
+			.ths_zerocnt = 8,
+			.ths_trailcnt = 5,
+
+			.csi_hs_lp_hs_ps = 544000,		/* 544 ns */
+		},
+		.vb_fifo = 2,
+	},
+	{
+		/* config 320 */
+		.input = {
+			.mbus_fmt = MEDIA_BUS_FMT_RGB888_1X24,
+			.refclk = 24000000,			/* Hz */
+			.link_frequency = 249000000,		/* Hz */
+			.num_lanes = 2,
+			.discontinuous_clk = false,
+			.hs_lp_hs_model = TC358746_HS_LP_HS_LEGACY,
+			.hs_lp_hs_margin = 0,		/* % */
+			.pclk = 20000000,			/* Hz */
+			.width = 320,
+			.hblank = 1084,
+			.height = 240,
+			.vblank = 0,
+			.framerate = 60020000,		/* fps * 1000000 */
+		},
+		.pll = {
+			.pllinclk_hz = 4000000,
+			.pll_prd = 6,
+			.pll_fbd = 249,
+		},
+		.csi = {
+			.speed_range = 1,			/* 250MHz – 500MHz HSCK frequency */
+			.unit_clk_hz = 2000000,
+			.unit_clk_mul = 249,
+			.speed_per_lane = 498000000,		/* bps/lane */
+			.lane_num = 2,
+			.is_continuous_clk = true,		/* CSI clock during LP enabled */
+
+			/* CSI2-TX Parameters */
+			.lineinitcnt = 3424,
+			.lptxtimecnt = 3,
+			.twakeupcnt = 18674,
+			.tclk_preparecnt = 3,
+			.tclk_zerocnt = 17,
+			.tclk_trailcnt = 0,
+			.tclk_postcnt = 8,
+			.ths_preparecnt = 3,
+			.ths_zerocnt = 0,
+			.ths_trailcnt = 1,
+
+			.csi_hs_lp_hs_ps = 803213,		/* 803 ns */
+		},
+		.vb_fifo = 124,
+	},
+	{
+		/* config 320 */
+		.input = {
+			.mbus_fmt = MEDIA_BUS_FMT_RGB888_1X24,
+			.refclk = 24000000,			/* Hz */
+			.link_frequency = 500000000,		/* Hz */
+			.num_lanes = 2,
+			.discontinuous_clk = false,
+			.hs_lp_hs_model = TC358746_HS_LP_HS_LEGACY,
+			.hs_lp_hs_margin = 0,		/* % */
+			.pclk = 20000000,			/* Hz */
+			.width = 320,
+			.hblank = 1084,
+			.height = 240,
+			.vblank = 0,
+			.framerate = 60020000,		/* fps * 1000000 */
+		},
+		.pll = {
+			.pllinclk_hz = 4000000,
+			.pll_prd = 6,
+			.pll_fbd = 250,
+		},
+		.csi = {
+			.speed_range = 0,			/* 500MHz - 1GHz HSCK frequency */
+			.unit_clk_hz = 4000000,
+			.unit_clk_mul = 250,
+			.speed_per_lane = 1000000000,		/* bps/lane */
+			.lane_num = 2,
+			.is_continuous_clk = true,		/* CSI clock during LP enabled */
+
+			/* CSI2-TX Parameters */
+			.lineinitcnt = 6875,
+			.lptxtimecnt = 6,
+			.twakeupcnt = 21428,
+			.tclk_preparecnt = 6,
+			.tclk_zerocnt = 36,
+			.tclk_trailcnt = 4,
+			.tclk_postcnt = 12,
+			.ths_preparecnt = 6,
+			.ths_zerocnt = 8,
+			.ths_trailcnt = 5,
+
+			.csi_hs_lp_hs_ps = 544000,		/* 544 ns */
+		},
+		.vb_fifo = 182,
+	},
+	{
+		/* config 1024 */
+		.input = {
+			.mbus_fmt = MEDIA_BUS_FMT_RGB888_1X24,
+			.refclk = 24000000,			/* Hz */
+			.link_frequency = 500000000,		/* Hz */
+			.num_lanes = 2,
+			.discontinuous_clk = false,
+			.hs_lp_hs_model = TC358746_HS_LP_HS_LEGACY,
+			.hs_lp_hs_margin = 0,		/* % */
+			.pclk = 83000000,			/* Hz */
+			.width = 1024,
+			.hblank = 55,
+			.height = 768,
+			.vblank = 0,
+			.framerate = 60756000,		/* fps * 1000000 */
+		},
+		.pll = {
+			.pllinclk_hz = 4000000,
+			.pll_prd = 6,
+			.pll_fbd = 250,
+		},
+		.csi = {
+			.speed_range = 0,			/* 500MHz - 1GHz HSCK frequency */
+			.unit_clk_hz = 4000000,
+			.unit_clk_mul = 250,
+			.speed_per_lane = 1000000000,		/* bps/lane */
+			.lane_num = 2,
+			.is_continuous_clk = true,		/* CSI clock during LP enabled */
+
+			/* CSI2-TX Parameters */
+			.lineinitcnt = 6875,
+			.lptxtimecnt = 6,
+			.twakeupcnt = 21428,
+			.tclk_preparecnt = 6,
+			.tclk_zerocnt = 36,
+			.tclk_trailcnt = 4,
+			.tclk_postcnt = 12,
+			.ths_preparecnt = 6,
+			.ths_zerocnt = 8,
+			.ths_trailcnt = 5,
+
+			.csi_hs_lp_hs_ps = 544000,		/* 544 ns */
+		},
+		.vb_fifo = 2,
+	},
+};
+
+#endif
@@ -0,0 +1,295 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * tc358746 - Parallel to CSI-2 bridge - register program of a mode
+ *
+ * References:
+ * REF_01:
+ * - TC358746AXBG/TC358748XBG/TC358748IXBG Functional Specification Rev 1.2
+ */
+
+#include <linux/module.h>
+#include <linux/bitops.h>
+
+#include "tc358746_program.h"
+#include "tc358746_regs.h"
+
+#define CSI_HSTXVREGCNT			5
+
+#define TC358746_SRESET_DELAY_US	10
+#define TC358746_PLL_LOCK_DELAY_US	1000
+
+static void tc358746_prog_update(struct tc358746_program *prog,
+				 enum tc358746_regmap regmap, u16 addr,
+				 u32 mask, u32 val, u16 delay_us)
+{
+	struct tc358746_reg_write *w = prog->writes + prog->num++;
+
+	w->regmap = regmap;
+	w->addr = addr;
+	w->delay_us = delay_us;
+	w->val = val;
+	w->mask = mask;
+}
+
+static void tc358746_prog_write(struct tc358746_program *prog,
+				enum tc358746_regmap regmap, u16 addr, u32 val)
+{
+	tc358746_prog_update(prog, regmap, addr, 0, val, 0);
+}
+
+static void tc358746_prog_sreset(struct tc358746_program *prog)
+{
+	tc358746_prog_update(prog, TC358746_REGMAP_CTL, SYSCTL, 0,
+			     SYSCTL_SRESET_MASK, TC358746_SRESET_DELAY_US);
+	tc358746_prog_write(prog, TC358746_REGMAP_CTL, SYSCTL, 0);
+}
+
+/* the clock is enabled after the pll locked */
+static void tc358746_prog_pll(struct tc358746_program *prog,
+			      const struct tc358746_pll *pll,
+			      const struct tc358746_csi *csi)
+{
+	tc358746_prog_write(prog, TC358746_REGMAP_CTL, PLLCTL0,
+			    PLLCTL0_PLL_PRD_SET(pll->pll_prd) |
+			    PLLCTL0_PLL_FBD_SET(pll->pll_fbd));
+	tc358746_prog_update(prog, TC358746_REGMAP_CTL, PLLCTL1,
+			     PLLCTL1_PLL_FRS_MASK | PLLCTL1_RESETB_MASK |
+			     PLLCTL1_PLL_EN_MASK,
+			     PLLCTL1_PLL_FRS_SET(csi->speed_range) |
+			     PLLCTL1_RESETB_MASK | PLLCTL1_PLL_EN_MASK,
+			     TC358746_PLL_LOCK_DELAY_US);
+	tc358746_prog_update(prog, TC358746_REGMAP_CTL, PLLCTL1,
+			     PLLCTL1_CKEN_MASK, PLLCTL1_CKEN_MASK, 0);
+}
+
+static void tc358746_prog_format(struct tc358746_program *prog,
+				 const struct tc358746_mbus_fmt *format,
+				 unsigned int width, u16 vb_fifo)
+{
+	tc358746_prog_update(prog, TC358746_REGMAP_CTL, DATAFMT,
+			     DATAFMT_PDFMT_MASK | DATAFMT_UDT_EN_MASK,
+			     DATAFMT_PDFMT_SET(format->pdformat), 0);
+	tc358746_prog_update(prog, TC358746_REGMAP_CTL, CONFCTL,
+			     CONFCTL_PDATAF_MASK,
+			     CONFCTL_PDATAF_SET(format->pdataf), 0);
+	tc358746_prog_write(prog, TC358746_REGMAP_CTL, FIFOCTL, vb_fifo);
+	tc358746_prog_write(prog, TC358746_REGMAP_CTL, WORDCNT,
+			    width * format->bpp / 8);
+}
+
+/* disable the unused data lanes, in one burst up to D3W_CNTRL */
+static void tc358746_prog_lanes(struct tc358746_program *prog,
+				unsigned int lane_num)
+{
+	static const struct {
+		u16 cntrl;
+		u32 disable;
+	} lanes[] = {
+		{ D1W_CNTRL, D1W_CNTRL_D1W_LANEDISABLE_MASK },
+		{ D2W_CNTRL, D2W_CNTRL_D2W_LANEDISABLE_MASK },
+		{ D3W_CNTRL, D2W_CNTRL_D3W_LANEDISABLE_MASK },
+	};
+	unsigned int i;
+
+	for (i = lane_num - 1; i < ARRAY_SIZE(lanes); i++)
+		tc358746_prog_write(prog, TC358746_REGMAP_TX, lanes[i].cntrl,
+				    lanes[i].disable);
+}
+
+/*
+ * The D-PHY timings and the regulators of the used lanes, in address order
+ * so they go out as one burst from LINEINITCNT to TXOPTIONCNTRL.
+ */
+static void tc358746_prog_csi(struct tc358746_program *prog,
+			      const struct tc358746_csi *csi)
+{
+	static const u32 vregen[] = {
+		HSTXVREGEN_D1M_HSTXVREGEN_MASK,
+		HSTXVREGEN_D2M_HSTXVREGEN_MASK,
+		HSTXVREGEN_D3M_HSTXVREGEN_MASK,
+	};
+	u32 val = HSTXVREGEN_CLM_HSTXVREGEN_MASK |
+		  HSTXVREGEN_D0M_HSTXVREGEN_MASK;
+	unsigned int i;
+
+	for (i = 0; i + 1 < csi->lane_num; i++)
+		val |= vregen[i];
+
+	tc358746_prog_write(prog, TC358746_REGMAP_TX, LINEINITCNT,
+			    csi->lineinitcnt);
+	tc358746_prog_write(prog, TC358746_REGMAP_TX, LPTXTIMECNT,
+			    csi->lptxtimecnt);
+	tc358746_prog_write(prog, TC358746_REGMAP_TX, TCLK_HEADERCNT,
+			    TCLK_HEADERCNT_TCLK_ZEROCNT_SET(csi->tclk_zerocnt) |
+			    TCLK_HEADERCNT_TCLK_PREPARECNT_SET(csi->tclk_preparecnt));
+	tc358746_prog_write(prog, TC358746_REGMAP_TX, TCLK_TRAILCNT,
+			    csi->tclk_trailcnt);
+	tc358746_prog_write(prog, TC358746_REGMAP_TX, THS_HEADERCNT,
+			    THS_HEADERCNT_THS_ZEROCNT_SET(csi->ths_zerocnt) |
+			    THS_HEADERCNT_THS_PREPARECNT_SET(csi->ths_preparecnt));
+	tc358746_prog_write(prog, TC358746_REGMAP_TX, TWAKEUP,
+			    csi->twakeupcnt);
+	tc358746_prog_write(prog, TC358746_REGMAP_TX, TCLK_POSTCNT,
+			    csi->tclk_postcnt);
+	tc358746_prog_write(prog, TC358746_REGMAP_TX, THS_TRAILCNT,
+			    csi->ths_trailcnt);
+	tc358746_prog_write(prog, TC358746_REGMAP_TX, HSTXVREGCNT,
+			    CSI_HSTXVREGCNT);
+	tc358746_prog_write(prog, TC358746_REGMAP_TX, HSTXVREGEN, val);
+	tc358746_prog_write(prog, TC358746_REGMAP_TX, TXOPTIONCNTRL,
+			    csi->is_continuous_clk ?
+			    TXOPTIONCNTRL_CONTCLKMODE_MASK : 0);
+}
+
+static void tc358746_prog_start(struct tc358746_program *prog,
+				unsigned int lane_num)
+{
+	static const u32 nol[] = {
+		CSI_CONTROL_NOL_1_MASK, CSI_CONTROL_NOL_2_MASK,
+		CSI_CONTROL_NOL_3_MASK, CSI_CONTROL_NOL_4_MASK,
+	};
+	u32 val;
+
+	tc358746_prog_write(prog, TC358746_REGMAP_TX, STARTCNTRL,
+			    STARTCNTRL_START_MASK);
+	tc358746_prog_write(prog, TC358746_REGMAP_TX, CSI_START,
+			    CSI_START_STRT_MASK);
+
+	/* CSI_CONTROL is written through CSI_CONFW */
+	val = nol[lane_num - 1] | CSI_CONTROL_CSI_MODE_MASK |
+	      CSI_CONTROL_TXHSMD_MASK |
+	      CSI_CONTROL_EOTDIS_MASK; /* add, according to Excel */
+	val &= CSI_CONFW_DATA_MASK;
+	val |= CSI_CONFW_MODE_SET_MASK | CSI_CONFW_ADDRESS_CSI_CONTROL_MASK;
+	tc358746_prog_write(prog, TC358746_REGMAP_TX, CSI_CONFW, val);
+}
+
+/*
+ * Compile the parameters @self calculated for @input into the register
+ * program of the mode: the software reset, the pll, the parallel format and
+ * buffers, the csi lanes and timings and at last the csi start. Running the
+ * writes of @prog in order, each followed by its delay, sets the mode up.
+ */
+int tc358746_program(const struct tc358746 *self,
+		     const struct tc358746_input *input,
+		     struct tc358746_program *prog)
+{
+	unsigned int lane_num = self->csi.lane_num;
+
+	if (!self->format || lane_num < 1 || lane_num > 4)
+		return -EINVAL;
+
+	prog->num = 0;
+	tc358746_prog_sreset(prog);
+	tc358746_prog_pll(prog, &self->pll, &self->csi);
+	tc358746_prog_format(prog, self->format, input->width, self->vb_fifo);
+	tc358746_prog_lanes(prog, lane_num);
+	tc358746_prog_csi(prog, &self->csi);
+	tc358746_prog_start(prog, lane_num);
+
+	return 0;
+}
+
+/*
+ * Number of writes of @prog from @first on that can go out as one bulk
+ * write, the bridge increments the address within an I2C transaction: whole
+ * register writes to consecutive registers of one register space, only the
+ * last of them followed by a delay.
+ */
+unsigned int tc358746_program_burst(const struct tc358746_program *prog,
+				    unsigned int first)
+{
+	const struct tc358746_reg_write *w = prog->writes + first;
+	unsigned int stride, num = 1;
+
+	if (w->mask)
+		return 1;
+
+	stride = w->regmap == TC358746_REGMAP_TX ? 4 : 2;
+	while (first + num < prog->num && !w[num - 1].delay_us &&
+	       !w[num].mask && w[num].regmap == w->regmap &&
+	       w[num].addr == w->addr + num * stride)
+		num++;
+
+	return num;
+}
+
+/* @w of @prog is already programmed the same way, NULL if not */
+static const struct tc358746_reg_write *
+tc358746_prog_find(const struct tc358746_program *prog,
+		   const struct tc358746_reg_write *w)
+{
+	unsigned int i;
+
+	for (i = 0; i < prog->num; i++) {
+		const struct tc358746_reg_write *p = prog->writes + i;
+
+		if (p->regmap == w->regmap && p->addr == w->addr &&
+		    p->mask == w->mask && p->val == w->val)
+			return p;
+	}
+
+	return NULL;
+}
+
+/* registers that need the software reset when they change */
+static bool tc358746_prog_needs_reset(const struct tc358746_reg_write *w)
+{
+	if (w->regmap == TC358746_REGMAP_CTL)
+		return w->addr == PLLCTL0 || w->addr == PLLCTL1;
+
+	return (w->addr >= CLW_CNTRL && w->addr <= D3W_CNTRL) ||
+	       w->addr == HSTXVREGEN || w->addr == TXOPTIONCNTRL ||
+	       w->addr == CSI_CONFW;
+}
+
+/*
+ * The stream stop writes CSIRESET with RESET_CNF and RESET_MODULE, which
+ * reset the csi tx configuration and module (REF_01, CSIRESET). Which of
+ * the tx registers keep their value through that isn't spelled out, so
+ * every tx write is repeated after it, the start included. The control
+ * registers and the pll aren't touched by a csi reset.
+ */
+static bool tc358746_prog_csi_reset(const struct tc358746_reg_write *w)
+{
+	return w->regmap == TC358746_REGMAP_TX;
+}
+
+/*
+ * The writes of @prog a bridge programmed with @shadow, and stopped since,
+ * needs. If the pll and the lane settings, lane count and clock mode, are
+ * the same in both, the software reset and every control register write
+ * the bridge already holds are left out. The tx registers are always
+ * written, see tc358746_prog_csi_reset(). Otherwise @delta is all of
+ * @prog. Returns the number of writes left out.
+ */
+unsigned int tc358746_program_delta(const struct tc358746_program *shadow,
+				    const struct tc358746_program *prog,
+				    struct tc358746_program *delta)
+{
+	const struct tc358746_reg_write *w;
+	unsigned int i;
+
+	for (i = 0; i < prog->num; i++) {
+		w = prog->writes + i;
+		if (tc358746_prog_needs_reset(w) &&
+		    !tc358746_prog_find(shadow, w)) {
+			*delta = *prog;
+			return 0;
+		}
+	}
+
+	delta->num = 0;
+	for (i = 0; i < prog->num; i++) {
+		w = prog->writes + i;
+		if (w->regmap == TC358746_REGMAP_CTL && w->addr == SYSCTL)
+			continue;
+		if (!tc358746_prog_csi_reset(w) &&
+		    tc358746_prog_find(shadow, w))
+			continue;
+
+		delta->writes[delta->num++] = *w;
+	}
+
+	return prog->num - delta->num;
+}
@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef __TC358746_PROGRAM_H
+#define __TC358746_PROGRAM_H
+
+#include "tc358746_calculation.h"
+
+/* the register spaces, 16 bit control and 32 bit csi tx registers */
+enum tc358746_regmap {
+	TC358746_REGMAP_CTL,
+	TC358746_REGMAP_TX,
+};
+
+/*
+ * One write of a register program. Only the bits of mask are written, a mask
+ * of 0 writes the whole register. The write is followed by a delay of
+ * delay_us.
+ */
+struct tc358746_reg_write {
+	u8 regmap;		/* enum tc358746_regmap */
+	u16 addr;
+	u16 delay_us;
+	u32 val;
+	u32 mask;
+};
+
+/* reset, pll, format, buffers, 3 lanes, 11 timings and the csi start */
+#define TC358746_PROGRAM_MAX	32
+
+/*
+ * Every register write of a mode in the order the bridge takes them, see
+ * tc358746_program().
+ */
+struct tc358746_program {
+	unsigned int num;
+	struct tc358746_reg_write writes[TC358746_PROGRAM_MAX];
+};
+
+int tc358746_program(const struct tc358746 *self,
+		     const struct tc358746_input *input,
+		     struct tc358746_program *prog);
+unsigned int tc358746_program_burst(const struct tc358746_program *prog,
+				    unsigned int first);
+unsigned int tc358746_program_delta(const struct tc358746_program *shadow,
+				    const struct tc358746_program *prog,
+				    struct tc358746_program *delta);
+
+#endif
@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * tc358746 - Parallel to CSI-2 bridge - run a register program on the
+ * regmaps of the bridge
+ *
+ * References:
+ * REF_01:
+ * - TC358746AXBG/TC358748XBG/TC358748IXBG Functional Specification Rev 1.2
+ */
+
+#include <linux/module.h>
+#include <linux/bitops.h>
+#include <linux/delay.h>
+#include <linux/regmap.h>
+
+#include "tc358746_regmap.h"
+#include "tc358746_regs.h"
+
+/*
+ * The bridge lost the cached registers, the pll too if @pll is set. The
+ * next update_bits() of one reads it from the bridge again.
+ *
+ * The cache is dropped rather than synced back: regcache_sync() after a
+ * reset would replay the configuration of the previous mode, including
+ * the pll while it locks, before the program of the new mode is written.
+ */
+void tc358746_regcache_reset(struct regmap *ctl_regmap,
+			     struct regmap *tx_regmap, bool pll)
+{
+	if (pll) {
+		regcache_drop_region(ctl_regmap, CONFCTL, 0x00ff);
+	} else {
+		regcache_drop_region(ctl_regmap, CONFCTL, PLLCTL0 - 2);
+		regcache_drop_region(ctl_regmap, PLLCTL1 + 2, 0x00ff);
+	}
+
+	if (tx_regmap)
+		regcache_drop_region(tx_regmap, 0x0100, 0x05ff);
+}
+
+/* @num writes to consecutive registers in one I2C transaction */
+static int tc358746_write_burst(struct regmap *regmap,
+				const struct tc358746_reg_write *w,
+				unsigned int num)
+{
+	u32 val32[TC358746_PROGRAM_MAX];
+	u16 val16[TC358746_PROGRAM_MAX];
+	unsigned int i;
+
+	if (w->regmap == TC358746_REGMAP_TX) {
+		for (i = 0; i < num; i++)
+			val32[i] = w[i].val;
+		return regmap_bulk_write(regmap, w->addr, val32, num);
+	}
+
+	for (i = 0; i < num; i++)
+		val16[i] = w[i].val;
+	return regmap_bulk_write(regmap, w->addr, val16, num);
+}
+
+/*
+ * Run the register program of a mode, consecutive registers in bursts, see
+ * tc358746_program_burst(). Rewriting the pll triggers another format
+ * change event, so its writes are skipped if it already runs with the
+ * setting of the program.
+ */
+int tc358746_run_program(struct regmap *ctl_regmap, struct regmap *tx_regmap,
+			 const struct tc358746_program *prog)
+{
+	const struct tc358746_reg_write *w;
+	u32 pllctl0, pllctl1;
+	bool pll_keep = false, sreset = false;
+	unsigned int i, num;
+	int err = 0;
+
+	for (i = 0; i < prog->num && !err; i += num) {
+		struct regmap *regmap;
+
+		w = prog->writes + i;
+		num = 1;
+		regmap = w->regmap == TC358746_REGMAP_TX ? tx_regmap :
+							   ctl_regmap;
+
+		if (w->regmap == TC358746_REGMAP_CTL && w->addr == PLLCTL0) {
+			err = regmap_read(regmap, PLLCTL0, &pllctl0);
+			if (!err)
+				err = regmap_read(regmap, PLLCTL1, &pllctl1);
+			if (err)
+				break;
+
+			pll_keep = pllctl0 == w->val &&
+				   (pllctl1 & PLLCTL1_PLL_EN_MASK);
+		}
+
+		if (pll_keep && w->regmap == TC358746_REGMAP_CTL &&
+		    (w->addr == PLLCTL0 || w->addr == PLLCTL1))
+			continue;
+
+		num = tc358746_program_burst(prog, i);
+		if (num > 1) {
+			err = tc358746_write_burst(regmap, w, num);
+			w += num - 1;
+		} else if (w->mask) {
+			err = regmap_update_bits(regmap, w->addr, w->mask,
+						 w->val);
+		} else {
+			err = regmap_write(regmap, w->addr, w->val);
+		}
+
+		if (w->delay_us)
+			udelay(w->delay_us);
+
+		/* the software reset keeps the pll running */
+		if (!err && w->regmap == TC358746_REGMAP_CTL &&
+		    w->addr == SYSCTL) {
+			if (sreset && !(w->val & SYSCTL_SRESET_MASK))
+				tc358746_regcache_reset(ctl_regmap, tx_regmap,
+							false);
+			sreset = w->val & SYSCTL_SRESET_MASK;
+		}
+	}
+
+	return err;
+}
@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+
+#ifndef __TC358746_REGMAP_H
+#define __TC358746_REGMAP_H
+
+#include "tc358746_program.h"
+
+struct regmap;
+
+void tc358746_regcache_reset(struct regmap *ctl_regmap,
+			     struct regmap *tx_regmap, bool pll);
+int tc358746_run_program(struct regmap *ctl_regmap, struct regmap *tx_regmap,
+			 const struct tc358746_program *prog);
+
+#endif